@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "textfile.h"
+#include "primitives.h"
 
 #include "Vectors.h"
 #include "Matrices.h"
@@ -263,42 +264,8 @@ void ChangeSize(GLFWwindow* window, int width, int height)
 
 void drawPlane()
 {
-	GLfloat vertices[18]{ 1.0, -0.9, -1.0,
-		1.0, -0.9,  1.0,
-		-1.0, -0.9, -1.0,
-		1.0, -0.9,  1.0,
-		-1.0, -0.9,  1.0,
-		-1.0, -0.9, -1.0 };
-
-	GLfloat colors[18]{ 0.0,1.0,0.0,
-		0.0,0.5,0.8,
-		0.0,1.0,0.0,
-		0.0,0.5,0.8,
-		0.0,0.5,0.8,
-		0.0,1.0,0.0 };
-
-	// [TODO] draw the plane with above vertices and color
-	
-	// Vertex buffers
-	GLuint VAO, VBO, COLOR_VBO;
-
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
-
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
-
-	glGenBuffers(1, &COLOR_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, COLOR_VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(colors), colors, GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
-
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-
+	// the plane's buffers are built once in InitPrimitives
+	DrawPrimitive(GetPrimitive(PRIMITIVE_PLANE));
 }
 
 // Render function for display rendering
@@ -351,7 +318,7 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 {
 	// [TODO] Call back function for keyboard
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-		exit(0);
+		glfwSetWindowShouldClose(window, GL_TRUE);	// leave the main loop so the buffers get deleted
 	else if (key == GLFW_KEY_Z && action == GLFW_PRESS)
 	{
 		cur_idx--;
@@ -761,29 +728,14 @@ void LoadModels(string model_path)
 	normalization(&attrib, vertices, colors, &shapes[0]);
 
 	Shape tmp_shape;
-	glGenVertexArrays(1, &tmp_shape.vao);
-	glBindVertexArray(tmp_shape.vao);
-
-	glGenBuffers(1, &tmp_shape.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.vbo);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GL_FLOAT), &vertices.at(0), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
 	tmp_shape.vertex_count = vertices.size() / 3;
-
-	glGenBuffers(1, &tmp_shape.p_color);
-	glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_color);
-	glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(GL_FLOAT), &colors.at(0), GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	// same vertex format as the primitives
+	CreateColoredVertexArray(&vertices.at(0), &colors.at(0), tmp_shape.vertex_count, tmp_shape.vao, tmp_shape.vbo, tmp_shape.p_color);
 
 	m_shape_list.push_back(tmp_shape);
 	model tmp_model;
 	models.push_back(tmp_model);
 
-
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-
 	shapes.clear();
 	materials.clear();
 }
@@ -815,6 +767,7 @@ void setupRC()
 
 	// OpenGL States and Values
 	glClearColor(0.2, 0.2, 0.2, 1.0);
+	InitPrimitives();
 	vector<string> model_list{ "../ColorModels/bunny5KC.obj", "../ColorModels/dragon10KC.obj", "../ColorModels/lucy25KC.obj", "../ColorModels/teapot4KC.obj", "../ColorModels/dolphinC.obj"};
 	// [TODO] Load five model at here
 	//LoadModels(model_list[cur_idx]);
@@ -895,6 +848,14 @@ int main(int argc, char **argv)
         // Poll input event
         glfwPollEvents();
     }
+
+	for (size_t i = 0; i < m_shape_list.size(); i++)
+	{
+		glDeleteVertexArrays(1, &m_shape_list[i].vao);
+		glDeleteBuffers(1, &m_shape_list[i].vbo);
+		glDeleteBuffers(1, &m_shape_list[i].p_color);
+	}
+	DeletePrimitives();
 	
 	// just for compatibiliy purposes
 	return 0;
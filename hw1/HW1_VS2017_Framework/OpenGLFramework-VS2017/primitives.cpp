@@ -0,0 +1,176 @@
+#include <vector>
+#include <math.h>
+#include "primitives.h"
+
+using namespace std;
+
+namespace
+{
+	const float PRIMITIVE_PI = 3.1415926f;
+
+	struct PrimitiveBuffers
+	{
+		PrimitiveHandle handle = { 0, GL_TRIANGLES, 0 };
+		GLuint vbo = 0;
+		GLuint colorVbo = 0;
+	};
+	PrimitiveBuffers primitives[PRIMITIVE_COUNT];
+
+	void AddVertex(vector<GLfloat>& vertices, vector<GLfloat>& colors, float x, float y, float z, float r, float g, float b)
+	{
+		vertices.push_back(x);
+		vertices.push_back(y);
+		vertices.push_back(z);
+		colors.push_back(r);
+		colors.push_back(g);
+		colors.push_back(b);
+	}
+
+	void BuildPlane(vector<GLfloat>& vertices, vector<GLfloat>& colors)
+	{
+		const GLfloat plane_vertices[18] = { 1.0, -0.9, -1.0,
+			1.0, -0.9,  1.0,
+			-1.0, -0.9, -1.0,
+			1.0, -0.9,  1.0,
+			-1.0, -0.9,  1.0,
+			-1.0, -0.9, -1.0 };
+
+		const GLfloat plane_colors[18] = { 0.0,1.0,0.0,
+			0.0,0.5,0.8,
+			0.0,1.0,0.0,
+			0.0,0.5,0.8,
+			0.0,0.5,0.8,
+			0.0,1.0,0.0 };
+
+		vertices.assign(plane_vertices, plane_vertices + 18);
+		colors.assign(plane_colors, plane_colors + 18);
+	}
+
+	void BuildQuad(vector<GLfloat>& vertices, vector<GLfloat>& colors)
+	{
+		const float corners[6][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, -1 }, { 1, 1 }, { -1, 1 } };
+		for (int i = 0; i < 6; i++)
+			AddVertex(vertices, colors, corners[i][0], corners[i][1], 0, corners[i][0] * 0.5f + 0.5f, corners[i][1] * 0.5f + 0.5f, 0.5f);
+	}
+
+	void BuildCube(vector<GLfloat>& vertices, vector<GLfloat>& colors)
+	{
+		// each face spans two axes, the third one is fixed at -1 or 1
+		for (int axis = 0; axis < 3; axis++)
+		{
+			for (int side = -1; side <= 1; side += 2)
+			{
+				int u = (axis + 1) % 3, v = (axis + 2) % 3;
+				const float corners[6][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, -1 }, { 1, 1 }, { -1, 1 } };
+				for (int i = 0; i < 6; i++)
+				{
+					// swap the winding on the negative side so every face stays counter clockwise from outside
+					int c = side > 0 ? i : 5 - i;
+					float p[3];
+					p[axis] = (float)side;
+					p[u] = corners[c][0];
+					p[v] = corners[c][1];
+					float color[3] = { 0.2f, 0.2f, 0.2f };
+					color[axis] = side > 0 ? 1.0f : 0.6f;
+					AddVertex(vertices, colors, p[0], p[1], p[2], color[0], color[1], color[2]);
+				}
+			}
+		}
+	}
+
+	void BuildSphere(vector<GLfloat>& vertices, vector<GLfloat>& colors)
+	{
+		const int stacks = 16, slices = 32;
+		for (int i = 0; i < stacks; i++)
+		{
+			for (int j = 0; j < slices; j++)
+			{
+				// two triangles per cell between latitudes i, i + 1 and longitudes j, j + 1
+				const int cell[6][2] = { { i, j }, { i + 1, j }, { i + 1, j + 1 }, { i, j }, { i + 1, j + 1 }, { i, j + 1 } };
+				for (int k = 0; k < 6; k++)
+				{
+					float theta = PRIMITIVE_PI * cell[k][0] / stacks;
+					float phi = 2.0f * PRIMITIVE_PI * cell[k][1] / slices;
+					float x = sinf(theta) * cosf(phi), y = cosf(theta), z = -sinf(theta) * sinf(phi);
+					AddVertex(vertices, colors, x, y, z, x * 0.5f + 0.5f, y * 0.5f + 0.5f, z * 0.5f + 0.5f);
+				}
+			}
+		}
+	}
+
+	void BuildGrid(vector<GLfloat>& vertices, vector<GLfloat>& colors)
+	{
+		const int lines = 10;
+		for (int i = 0; i <= lines; i++)
+		{
+			float t = -1.0f + 2.0f * i / lines;
+			AddVertex(vertices, colors, t, -0.89f, -1.0f, 0.8f, 0.8f, 0.8f);
+			AddVertex(vertices, colors, t, -0.89f, 1.0f, 0.8f, 0.8f, 0.8f);
+			AddVertex(vertices, colors, -1.0f, -0.89f, t, 0.8f, 0.8f, 0.8f);
+			AddVertex(vertices, colors, 1.0f, -0.89f, t, 0.8f, 0.8f, 0.8f);
+		}
+	}
+}
+
+void CreateColoredVertexArray(const GLfloat* vertices, const GLfloat* colors, int vertex_count, GLuint& vao, GLuint& vbo, GLuint& color_vbo)
+{
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertex_count * 3 * sizeof(GLfloat), vertices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glGenBuffers(1, &color_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, color_vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertex_count * 3 * sizeof(GLfloat), colors, GL_STATIC_DRAW);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+}
+
+void InitPrimitives()
+{
+	typedef void (*BuildFunction)(vector<GLfloat>&, vector<GLfloat>&);
+	const BuildFunction builders[PRIMITIVE_COUNT] = { BuildPlane, BuildQuad, BuildCube, BuildSphere, BuildGrid };
+
+	for (int i = 0; i < PRIMITIVE_COUNT; i++)
+	{
+		if (primitives[i].handle.vao != 0)
+			continue;
+
+		vector<GLfloat> vertices, colors;
+		builders[i](vertices, colors);
+		PrimitiveBuffers& primitive = primitives[i];
+		primitive.handle.mode = i == PRIMITIVE_GRID ? GL_LINES : GL_TRIANGLES;
+		primitive.handle.vertexCount = (GLsizei)(vertices.size() / 3);
+		CreateColoredVertexArray(&vertices[0], &colors[0], primitive.handle.vertexCount, primitive.handle.vao, primitive.vbo, primitive.colorVbo);
+	}
+	glBindVertexArray(0);
+}
+
+PrimitiveHandle GetPrimitive(PrimitiveType type)
+{
+	return primitives[type].handle;
+}
+
+void DrawPrimitive(const PrimitiveHandle& primitive)
+{
+	if (primitive.vao == 0)
+		return;
+	glBindVertexArray(primitive.vao);
+	glDrawArrays(primitive.mode, 0, primitive.vertexCount);
+}
+
+void DeletePrimitives()
+{
+	for (int i = 0; i < PRIMITIVE_COUNT; i++)
+	{
+		glDeleteVertexArrays(1, &primitives[i].handle.vao);
+		glDeleteBuffers(1, &primitives[i].vbo);
+		glDeleteBuffers(1, &primitives[i].colorVbo);
+		primitives[i] = PrimitiveBuffers();
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <glad/glad.h>
+
+// Primitive registry
+// Built-in shapes stored in the same vertex format as the loaded models: positions at location 0
+// and colors at location 1, three floats each in their own buffer. Every primitive's vertex array
+// is built once in InitPrimitives; drawing one only binds its vertex array, so nothing is created
+// or uploaded per frame.
+
+enum PrimitiveType
+{
+	PRIMITIVE_PLANE = 0,	// floor under the models, y = -0.9
+	PRIMITIVE_QUAD = 1,		// [-1, 1] square in the xy plane
+	PRIMITIVE_CUBE = 2,		// [-1, 1] cube, one color per face
+	PRIMITIVE_SPHERE = 3,	// unit sphere colored by its normal
+	PRIMITIVE_GRID = 4,		// lines every 0.2 over the floor
+	PRIMITIVE_COUNT = 5
+};
+
+// What a draw needs, cheap to copy around
+struct PrimitiveHandle
+{
+	GLuint vao;
+	GLenum mode;
+	GLsizei vertexCount;
+};
+
+// Vertex array in the model format for vertex_count vertices; the buffers are returned so the caller can delete them
+void CreateColoredVertexArray(const GLfloat* vertices, const GLfloat* colors, int vertex_count, GLuint& vao, GLuint& vbo, GLuint& color_vbo);
+
+// Build every primitive, needs a current context
+void InitPrimitives();
+PrimitiveHandle GetPrimitive(PrimitiveType type);
+void DrawPrimitive(const PrimitiveHandle& primitive);
+void DeletePrimitives();
+
+#endif
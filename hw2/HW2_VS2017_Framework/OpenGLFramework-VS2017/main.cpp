@@ -6,6 +6,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "textfile.h"
+#include "vertexformat.h"
 
 #include "Vectors.h"
 #include "Matrices.h"
@@ -55,12 +56,10 @@ struct PhongMaterial
 typedef struct
 {
 	GLuint vao;
-	GLuint vbo;
+	GLuint vbo;			// interleaved position, color and normal
 	GLuint vboTex;
 	GLuint ebo;
-	GLuint p_color;
 	int vertex_count;
-	GLuint p_normal;
 	PhongMaterial material;
 	int indexCount;
 	GLuint m_texture;
@@ -910,31 +909,21 @@ void LoadModels(string model_path)
 		normals.clear();
 		normalization(&attrib, vertices, colors, normals, &shapes[i]);
 		// printf("Vertices size: %d", vertices.size() / 3);
+		if (vertices.empty())
+			continue;
 
 		Shape tmp_shape;
 		glGenVertexArrays(1, &tmp_shape.vao);
 		glBindVertexArray(tmp_shape.vao);
 
-		glGenBuffers(1, &tmp_shape.vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.vbo);
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GL_FLOAT), &vertices.at(0), GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		// a shape without normals in the file carries no normal attribute
+		unsigned int mask = 1 << ATTRIB_POSITION | 1 << ATTRIB_COLOR;
+		if (normals.size() == vertices.size())
+			mask |= 1 << ATTRIB_NORMAL;
+		const GLfloat* streams[ATTRIB_COUNT] = { &vertices[0], &colors[0], normals.empty() ? NULL : &normals[0], NULL };
+		tmp_shape.vbo = UploadVertices(MakeVertexFormat(mask), streams, (int)(vertices.size() / 3));
 		tmp_shape.vertex_count = vertices.size() / 3;
 
-		glGenBuffers(1, &tmp_shape.p_color);
-		glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_color);
-		glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(GL_FLOAT), &colors.at(0), GL_STATIC_DRAW);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glGenBuffers(1, &tmp_shape.p_normal);
-		glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_normal);	
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(GL_FLOAT), &normals.at(0), GL_STATIC_DRAW);
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glEnableVertexAttribArray(0);
-		glEnableVertexAttribArray(1);
-		glEnableVertexAttribArray(2);
-
 		// not support per face material, use material of first face
 		if (allMaterial.size() > 0)
 			tmp_shape.material = allMaterial[shapes[i].mesh.material_ids[0]];
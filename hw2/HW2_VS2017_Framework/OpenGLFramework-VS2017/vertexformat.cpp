@@ -0,0 +1,59 @@
+#include <vector>
+#include <string.h>
+#include "vertexformat.h"
+
+using namespace std;
+
+namespace
+{
+	const int ATTRIBUTE_COMPONENTS[ATTRIB_COUNT] = { 3, 3, 3, 2 };
+}
+
+VertexFormat MakeVertexFormat(unsigned int mask)
+{
+	VertexFormat format;
+	format.mask = mask;
+	format.stride = 0;
+	for (int i = 0; i < ATTRIB_COUNT; i++)
+	{
+		bool present = (mask & (1u << i)) != 0;
+		format.components[i] = present ? ATTRIBUTE_COMPONENTS[i] : 0;
+		format.offsets[i] = format.stride;
+		format.stride += format.components[i] * (int)sizeof(GLfloat);
+	}
+	return format;
+}
+
+GLuint UploadVertices(const VertexFormat& format, const GLfloat* const* streams, int vertex_count)
+{
+	// gather the streams into one vertex after another
+	int floatsPerVertex = format.stride / (int)sizeof(GLfloat);
+	vector<GLfloat> interleaved((size_t)vertex_count * floatsPerVertex);
+	for (int i = 0; i < ATTRIB_COUNT; i++)
+	{
+		int components = format.components[i];
+		if (components == 0)
+			continue;
+
+		GLfloat* dst = &interleaved[format.offsets[i] / sizeof(GLfloat)];
+		const GLfloat* src = streams[i];
+		for (int v = 0; v < vertex_count; v++, dst += floatsPerVertex, src += components)
+		{
+			for (int c = 0; c < components; c++)
+				dst[c] = src[c];
+		}
+	}
+
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(GLfloat), interleaved.empty() ? NULL : &interleaved[0], GL_STATIC_DRAW);
+	for (int i = 0; i < ATTRIB_COUNT; i++)
+	{
+		if (format.components[i] == 0)
+			continue;
+		glVertexAttribPointer(i, format.components[i], GL_FLOAT, GL_FALSE, format.stride, (const void*)(size_t)format.offsets[i]);
+		glEnableVertexAttribArray(i);
+	}
+	return buffer;
+}
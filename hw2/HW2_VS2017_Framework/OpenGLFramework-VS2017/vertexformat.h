@@ -0,0 +1,36 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+// Vertex formats and buffer layouts
+// A format is the set of float attributes a mesh carries; attribute i is bound to shader location i.
+// Every vertex is packed into one buffer, [position color normal texcoord] back to back, so a vertex
+// fetch reads one contiguous stride.
+
+enum VertexAttribute
+{
+	ATTRIB_POSITION = 0,
+	ATTRIB_COLOR = 1,
+	ATTRIB_NORMAL = 2,
+	ATTRIB_TEXCOORD = 3,
+	ATTRIB_COUNT = 4
+};
+
+struct VertexFormat
+{
+	unsigned int mask;					// bit i set if attribute i is present
+	int components[ATTRIB_COUNT];		// floats per attribute, 0 when absent
+	int offsets[ATTRIB_COUNT];			// byte offset inside an interleaved vertex
+	int stride;							// bytes per interleaved vertex
+};
+
+// Format holding the attributes in mask, e.g. 1 << ATTRIB_POSITION | 1 << ATTRIB_NORMAL
+VertexFormat MakeVertexFormat(unsigned int mask);
+
+// Interleave vertex_count vertices whose attributes come as separate streams (streams[i] holds
+// components[i] floats per vertex) into a new buffer and return it. The vertex array must be bound;
+// attributes get enabled
+GLuint UploadVertices(const VertexFormat& format, const GLfloat* const* streams, int vertex_count);
+
+#endif
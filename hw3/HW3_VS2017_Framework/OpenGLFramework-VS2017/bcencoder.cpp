@@ -0,0 +1,242 @@
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <string.h>
+#include "bcencoder.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BC_USE_SSE2
+#endif
+
+using namespace std;
+
+namespace
+{
+	// Gather a 4x4 block of RGBA texels, clamping at the image border
+	void FetchBlock(const unsigned char* rgba, int width, int height, int bx, int by, unsigned char block[64])
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			int sy = min(by * 4 + y, height - 1);
+			for (int x = 0; x < 4; x++)
+			{
+				int sx = min(bx * 4 + x, width - 1);
+				memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+			}
+		}
+	}
+
+	// Per channel minimum and maximum of the 16 texels
+	void BlockBounds(const unsigned char block[64], unsigned char lo[4], unsigned char hi[4])
+	{
+#ifdef BC_USE_SSE2
+		__m128i r0 = _mm_loadu_si128((const __m128i*)(block + 0));
+		__m128i r1 = _mm_loadu_si128((const __m128i*)(block + 16));
+		__m128i r2 = _mm_loadu_si128((const __m128i*)(block + 32));
+		__m128i r3 = _mm_loadu_si128((const __m128i*)(block + 48));
+		__m128i mn = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+		__m128i mx = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+
+		// fold the four texels of each register into one
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		int l = _mm_cvtsi128_si32(mn), h = _mm_cvtsi128_si32(mx);
+		memcpy(lo, &l, 4);
+		memcpy(hi, &h, 4);
+#else
+		for (int c = 0; c < 4; c++)
+		{
+			lo[c] = 255;
+			hi[c] = 0;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				lo[c] = min(lo[c], block[i * 4 + c]);
+				hi[c] = max(hi[c], block[i * 4 + c]);
+			}
+		}
+#endif
+	}
+
+	unsigned short To565(const int c[3])
+	{
+		return (unsigned short)((((c[0] * 31 + 127) / 255) << 11) | (((c[1] * 63 + 127) / 255) << 5) | ((c[2] * 31 + 127) / 255));
+	}
+
+	void From565(unsigned short v, int c[3])
+	{
+		int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+		c[0] = (r << 3) | (r >> 2);
+		c[1] = (g << 2) | (g >> 4);
+		c[2] = (b << 3) | (b >> 2);
+	}
+
+	void EncodeColorBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		unsigned char lo[4], hi[4];
+		BlockBounds(block, lo, hi);
+
+		// the bounding box diagonal runs along +r; flip g and b when they fall as r rises
+		int mean[3] = { (lo[0] + hi[0]) / 2, (lo[1] + hi[1]) / 2, (lo[2] + hi[2]) / 2 };
+		int covG = 0, covB = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int dr = block[i * 4] - mean[0];
+			covG += dr * (block[i * 4 + 1] - mean[1]);
+			covB += dr * (block[i * 4 + 2] - mean[2]);
+		}
+
+		// inset the box by 1/16 of its extent so the endpoints land on the bulk of the texels
+		int maxC[3], minC[3];
+		for (int c = 0; c < 3; c++)
+		{
+			int inset = (hi[c] - lo[c]) >> 4;
+			maxC[c] = hi[c] - inset;
+			minC[c] = lo[c] + inset;
+		}
+		if (covG < 0)
+			swap(maxC[1], minC[1]);
+		if (covB < 0)
+			swap(maxC[2], minC[2]);
+
+		unsigned short c0 = To565(maxC), c1 = To565(minC);
+		unsigned int indices = 0;
+		if (c0 != c1)
+		{
+			// opaque four colour mode needs c0 > c1, swapping exchanges the roles of index 0 and 1
+			if (c0 < c1)
+				swap(c0, c1);
+
+			int e0[3], e1[3];
+			From565(c0, e0);
+			From565(c1, e1);
+			int dir[3] = { e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2] };
+			int len2 = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+			static const unsigned int remap[4] = { 0, 2, 3, 1 };
+			for (int i = 0; i < 16; i++)
+			{
+				int t = (block[i * 4] - e0[0]) * dir[0] + (block[i * 4 + 1] - e0[1]) * dir[1] + (block[i * 4 + 2] - e0[2]) * dir[2];
+				int q = (t * 3 + len2 / 2) / len2;
+				q = max(0, min(3, q));
+				indices |= remap[q] << (2 * i);
+			}
+		}
+
+		out[0] = (unsigned char)(c0 & 0xff);
+		out[1] = (unsigned char)(c0 >> 8);
+		out[2] = (unsigned char)(c1 & 0xff);
+		out[3] = (unsigned char)(c1 >> 8);
+		for (int b = 0; b < 4; b++)
+			out[4 + b] = (unsigned char)(indices >> (8 * b));
+	}
+
+	void EncodeAlphaBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		int a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			a0 = max(a0, (int)block[i * 4 + 3]);
+			a1 = min(a1, (int)block[i * 4 + 3]);
+		}
+
+		// eight level mode: code 0 is a0, code 1 is a1, codes 2..7 step from a0 towards a1
+		unsigned long long indices = 0;
+		if (a0 != a1)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				int q = ((a0 - block[i * 4 + 3]) * 7 + (a0 - a1) / 2) / (a0 - a1);
+				unsigned long long code = q == 0 ? 0 : (q == 7 ? 1 : q + 1);
+				indices |= code << (3 * i);
+			}
+		}
+
+		out[0] = (unsigned char)a0;
+		out[1] = (unsigned char)a1;
+		for (int b = 0; b < 6; b++)
+			out[2 + b] = (unsigned char)(indices >> (8 * b));
+	}
+
+	template <typename EncodeRows>
+	void ParallelRows(int blockRows, int threadCount, EncodeRows encodeRows)
+	{
+		if (threadCount <= 0)
+			threadCount = (int)thread::hardware_concurrency();
+		threadCount = max(1, min(threadCount, blockRows));
+
+		if (threadCount == 1)
+		{
+			encodeRows(0, blockRows);
+			return;
+		}
+
+		vector<thread> threads;
+		for (int i = 0; i < threadCount; i++)
+			threads.push_back(thread(encodeRows, blockRows * i / threadCount, blockRows * (i + 1) / threadCount));
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+}
+
+size_t BC1Size(int width, int height)
+{
+	return (size_t)max(1, (width + 3) / 4) * max(1, (height + 3) / 4) * 8;
+}
+
+size_t BC3Size(int width, int height)
+{
+	return (size_t)max(1, (width + 3) / 4) * max(1, (height + 3) / 4) * 16;
+}
+
+void CompressBC1(const unsigned char* rgba, int width, int height, unsigned char* out, int threadCount)
+{
+	int blocksX = max(1, (width + 3) / 4), blocksY = max(1, (height + 3) / 4);
+	ParallelRows(blocksY, threadCount, [=](int begin, int end)
+	{
+		unsigned char block[64];
+		for (int by = begin; by < end; by++)
+		{
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				FetchBlock(rgba, width, height, bx, by, block);
+				EncodeColorBlock(block, out + ((size_t)by * blocksX + bx) * 8);
+			}
+		}
+	});
+}
+
+void CompressBC3(const unsigned char* rgba, int width, int height, unsigned char* out, int threadCount)
+{
+	int blocksX = max(1, (width + 3) / 4), blocksY = max(1, (height + 3) / 4);
+	ParallelRows(blocksY, threadCount, [=](int begin, int end)
+	{
+		unsigned char block[64];
+		for (int by = begin; by < end; by++)
+		{
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				unsigned char* dst = out + ((size_t)by * blocksX + bx) * 16;
+				FetchBlock(rgba, width, height, bx, by, block);
+				EncodeAlphaBlock(block, dst);
+				EncodeColorBlock(block, dst + 8);
+			}
+		}
+	});
+}
+
+bool IsOpaque(const unsigned char* rgba, int width, int height)
+{
+	size_t count = (size_t)width * height;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (rgba[i * 4 + 3] != 255)
+			return false;
+	}
+	return true;
+}
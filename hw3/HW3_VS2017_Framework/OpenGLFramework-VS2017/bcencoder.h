@@ -0,0 +1,20 @@
+#ifndef BC_ENCODER_H
+#define BC_ENCODER_H
+
+#include <stddef.h>
+
+// S3TC block compression of RGBA8 images, 4x4 texels per block.
+// Edge blocks of images that are not a multiple of 4 repeat the last row and column.
+// BC1 stores 8 bytes per block and ignores alpha, BC3 stores 16 bytes per block with interpolated alpha.
+// threadCount splits the block rows across threads, 0 means one per hardware thread.
+
+size_t BC1Size(int width, int height);
+size_t BC3Size(int width, int height);
+
+void CompressBC1(const unsigned char* rgba, int width, int height, unsigned char* out, int threadCount);
+void CompressBC3(const unsigned char* rgba, int width, int height, unsigned char* out, int threadCount);
+
+// True if every texel has alpha 255, in which case BC1 loses nothing over BC3
+bool IsOpaque(const unsigned char* rgba, int width, int height);
+
+#endif
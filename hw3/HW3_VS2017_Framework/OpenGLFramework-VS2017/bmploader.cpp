@@ -0,0 +1,130 @@
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "bmploader.h"
+
+using namespace std;
+
+namespace
+{
+	const size_t FILE_HEADER_SIZE = 14;
+	const size_t INFO_HEADER_SIZE = 40;		// BITMAPINFOHEADER, the later headers extend it
+	const unsigned int BI_RGB = 0;
+
+	// BMP fields are little endian and not aligned
+	unsigned int ReadU32(const unsigned char* p)
+	{
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+	}
+
+	unsigned int ReadU16(const unsigned char* p)
+	{
+		return p[0] | (p[1] << 8);
+	}
+}
+
+bool MapFile(const string& path, MappedFile& file)
+{
+	file.data = NULL;
+	file.size = 0;
+#ifdef _WIN32
+	file.file = file.mapping = NULL;
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* view = mapping != NULL ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (view == NULL)
+	{
+		if (mapping != NULL)
+			CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file.file = handle;
+	file.mapping = mapping;
+	file.data = (const unsigned char*)view;
+	file.size = (size_t)size.QuadPart;
+#else
+	file.fd = open(path.c_str(), O_RDONLY);
+	if (file.fd < 0)
+		return false;
+
+	struct stat info;
+	void* view = MAP_FAILED;
+	if (fstat(file.fd, &info) == 0 && info.st_size > 0)
+		view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+	if (view == MAP_FAILED)
+	{
+		close(file.fd);
+		file.fd = -1;
+		return false;
+	}
+
+	file.data = (const unsigned char*)view;
+	file.size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void UnmapFile(MappedFile& file)
+{
+	if (file.data == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(file.data);
+	CloseHandle(file.mapping);
+	CloseHandle(file.file);
+	file.file = file.mapping = NULL;
+#else
+	munmap((void*)file.data, file.size);
+	close(file.fd);
+	file.fd = -1;
+#endif
+	file.data = NULL;
+	file.size = 0;
+}
+
+bool ParseBmp(const unsigned char* data, size_t size, BmpImage& image)
+{
+	if (data == NULL || size < FILE_HEADER_SIZE + INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M')
+		return false;
+
+	unsigned int offset = ReadU32(data + 10);
+	unsigned int headerSize = ReadU32(data + 14);
+	int width = (int)ReadU32(data + 18);
+	int height = (int)ReadU32(data + 22);
+	unsigned int bitsPerPixel = ReadU16(data + 28);
+	unsigned int compression = ReadU32(data + 30);
+
+	// a negative height marks a top-down image, which would need a flip
+	if (headerSize < INFO_HEADER_SIZE || width <= 0 || height <= 0 || bitsPerPixel != 24 || compression != BI_RGB)
+		return false;
+
+	size_t rowStride = ((size_t)width * 3 + 3) & ~(size_t)3;
+	if (offset > size || (size - offset) / rowStride < (size_t)height)
+		return false;
+
+	image.width = width;
+	image.height = height;
+	image.rowStride = (int)rowStride;
+	image.pixels = data + offset;
+	return true;
+}
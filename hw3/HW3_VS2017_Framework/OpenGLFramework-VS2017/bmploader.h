@@ -0,0 +1,37 @@
+#ifndef BMP_LOADER_H
+#define BMP_LOADER_H
+
+#include <string>
+#include <stddef.h>
+
+// Read-only memory mapping of a whole file
+struct MappedFile
+{
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;		// HANDLE
+	void* mapping;	// HANDLE
+#else
+	int fd;
+#endif
+};
+
+bool MapFile(const std::string& path, MappedFile& file);
+void UnmapFile(MappedFile& file);
+
+// Uncompressed 24-bit bottom-up BMP, the layout of every bundled texture.
+// Rows are stored bottom row first as BGR and padded to 4 bytes, which is exactly what
+// glTexImage2D expects with GL_BGR and an unpack alignment of 4, so pixels can be handed over as is.
+struct BmpImage
+{
+	int width;
+	int height;
+	int rowStride;					// bytes per row including the padding
+	const unsigned char* pixels;	// bottom row, points into the parsed memory
+};
+
+// False for anything else (top-down, palettized, RLE, bitfields, truncated); use stb_image for those
+bool ParseBmp(const unsigned char* data, size_t size, BmpImage& image);
+
+#endif
@@ -0,0 +1,105 @@
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "drawindirect.h"
+#include "ringbuffer.h"
+#include "glinfo.h"
+#include "glstate.h"
+
+using namespace std;
+
+namespace
+{
+	typedef void (APIENTRYP PFNMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+	PFNMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect = NULL;
+
+	vector<DrawElementsIndirectCommand> commands;
+	vector<GLint> drawMaterials;
+	int instanceCount = 1;
+}
+
+bool InitDrawIndirect()
+{
+	int version = GetGLVersion();
+
+	// baseInstance in the commands needs 4.2 or GL_ARB_base_instance
+	bool indirect = version >= 43 || (HasExtension("GL_ARB_multi_draw_indirect") && HasExtension("GL_ARB_draw_indirect"));
+	bool base_instance = version >= 42 || HasExtension("GL_ARB_base_instance");
+	if (!indirect || !base_instance)
+	{
+		cout << "InitDrawIndirect: Multi-draw-indirect not supported, drawing batch by batch" << endl;
+		return false;
+	}
+
+	multiDrawElementsIndirect = (PFNMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect");
+	if (multiDrawElementsIndirect == NULL)
+	{
+		cout << "InitDrawIndirect: glMultiDrawElementsIndirect not found, drawing batch by batch" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool IsDrawIndirectSupported()
+{
+	return multiDrawElementsIndirect != NULL;
+}
+
+void BeginIndirectDraws(int instance_count)
+{
+	commands.clear();
+	drawMaterials.clear();
+	instanceCount = instance_count;
+}
+
+void AddIndirectDraws(const MeshBatch& batch, GLint material)
+{
+	for (size_t i = 0; i < batch.counts.size(); i++)
+	{
+		DrawElementsIndirectCommand command;
+		command.count = batch.counts[i];
+		command.instanceCount = instanceCount;
+		command.firstIndex = (GLuint)((size_t)batch.indexOffsets[i] / sizeof(GLuint));
+		command.baseVertex = batch.baseVertices[i];
+		command.baseInstance = (GLuint)commands.size();
+		commands.push_back(command);
+		drawMaterials.push_back(material);
+	}
+}
+
+int SubmitIndirectDraws()
+{
+	if (commands.empty() || multiDrawElementsIndirect == NULL)
+		return 0;
+
+	// commands and materials are this frame's data, both go through the ring buffer
+	size_t command_bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+	size_t material_bytes = drawMaterials.size() * sizeof(GLint);
+	GLintptr command_offset, material_offset;
+	void* command_data = AllocateRing(command_bytes, sizeof(GLuint), command_offset);
+	void* material_data = AllocateRing(material_bytes, sizeof(GLint), material_offset);
+	if (command_data == NULL || material_data == NULL)
+		return 0;
+	memcpy(command_data, &commands[0], command_bytes);
+	memcpy(material_data, &drawMaterials[0], material_bytes);
+	FlushRing();
+
+	// entry baseInstance + instance / divisor, the divisor covers every instance of a command
+	SetBuffer(GL_ARRAY_BUFFER, GetRingBuffer());
+	glVertexAttribIPointer(DRAW_MATERIAL_ATTRIBUTE, 1, GL_INT, 0, (const void*)material_offset);
+	glVertexAttribDivisor(DRAW_MATERIAL_ATTRIBUTE, instanceCount);
+	glEnableVertexAttribArray(DRAW_MATERIAL_ATTRIBUTE);
+	SetBuffer(GL_DRAW_INDIRECT_BUFFER, GetRingBuffer());
+	multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)command_offset, (GLsizei)commands.size(), 0);
+	glDisableVertexAttribArray(DRAW_MATERIAL_ATTRIBUTE);
+	glVertexAttribDivisor(DRAW_MATERIAL_ATTRIBUTE, 0);
+
+	return (int)commands.size();
+}
+
+void DeleteDrawIndirect()
+{
+	multiDrawElementsIndirect = NULL;
+}
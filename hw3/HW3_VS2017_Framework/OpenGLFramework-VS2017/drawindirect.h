@@ -0,0 +1,41 @@
+#ifndef DRAW_INDIRECT_H
+#define DRAW_INDIRECT_H
+
+#include <glad/glad.h>
+#include "mesharena.h"
+
+// Multi-draw-indirect submission
+// With GL 4.3 or GL_ARB_multi_draw_indirect, the draws of a pass are collected as commands in a
+// draw-command buffer and submitted with a single glMultiDrawElementsIndirect. Before GL 4.6 the
+// shader has no gl_DrawID, so every command's baseInstance points at its entry of an instanced
+// attribute holding the draw's material index; the attribute's divisor is the instance count of
+// the draws, so all instances of a command read the same entry.
+// glad is generated for 4.2, the entry point is loaded here. Without support InitDrawIndirect
+// returns false and callers keep their per-batch loop.
+
+#define DRAW_MATERIAL_ATTRIBUTE 5		// shader location of aDrawMaterial
+
+// Layout the GL reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Detect the capability and load glMultiDrawElementsIndirect, needs a current context
+bool InitDrawIndirect();
+bool IsDrawIndirectSupported();
+
+// Start collecting the draws of one pass, every draw is instanced instance_count times
+void BeginIndirectDraws(int instance_count);
+// Add every mesh of the batch, drawn with the given material
+void AddIndirectDraws(const MeshBatch& batch, GLint material);
+// Write the commands to the ring buffer and draw them with the pool's vertex array bound; returns the commands issued
+int SubmitIndirectDraws();
+
+void DeleteDrawIndirect();
+
+#endif
@@ -0,0 +1,20 @@
+#version 330
+
+in vec2 texCoord;
+
+layout (location = 0) out uvec2 feedback;
+
+uniform uint textureId;		// texture handle + 1, 0 is left for empty pixels
+uniform vec2 textureSize0;	// level 0 size in texels
+uniform float lodBias;		// log2 of how much coarser this target is than the screen
+
+void main()
+{
+	// the level the sampler would pick: log2 of the longer texel footprint of a pixel
+	vec2 dx = dFdx(texCoord * textureSize0);
+	vec2 dy = dFdy(texCoord * textureSize0);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) - lodBias;
+
+	// 4 fractional bits, the CPU side divides by 16
+	feedback = uvec2(textureId, uint(clamp(lod, 0.0, 15.0) * 16.0));
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330
+
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec2 aTexCoord;
+layout (location = 4) in vec4 aInstance;	// stress grid offset and scale, as in shader.vs.glsl
+
+uniform mat4 mvp;
+
+out vec2 texCoord;
+
+void main()
+{
+	gl_Position = mvp * vec4(aPos * aInstance.w + aInstance.xyz, 1.0);
+	texCoord = aTexCoord;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <string.h>
+#include "glinfo.h"
+
+using namespace std;
+
+void glPrintContextInfo(bool printExtension)
+{
+	cout << "GL_VENDOR = " << (const char*)glGetString(GL_VENDOR) << endl;
+	cout << "GL_RENDERER = " << (const char*)glGetString(GL_RENDERER) << endl;
+	cout << "GL_VERSION = " << (const char*)glGetString(GL_VERSION) << endl;
+	cout << "GL_SHADING_LANGUAGE_VERSION = " << (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
+	if (printExtension)
+	{
+		GLint numExt;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &numExt);
+		cout << "GL_EXTENSIONS =" << endl;
+		for (GLint i = 0; i < numExt; i++)
+		{
+			cout << "\t" << (const char*)glGetStringi(GL_EXTENSIONS, i) << endl;
+		}
+	}
+}
+
+int GetGLVersion()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	return major * 10 + minor;
+}
+
+bool HasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,13 @@
+#ifndef GL_INFO_H
+#define GL_INFO_H
+
+#include <glad/glad.h>
+
+// Context queries, all need a current context
+
+void glPrintContextInfo(bool printExtension);
+// major * 10 + minor of the context, 33 for 3.3
+int GetGLVersion();
+bool HasExtension(const char* name);
+
+#endif
@@ -0,0 +1,204 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include "globject.h"
+#include "glstate.h"
+
+using namespace std;
+
+namespace
+{
+	const char* CATEGORY_NAMES[GL_OBJECT_CATEGORY_COUNT] = { "buffers", "vertex arrays", "textures", "samplers", "programs", "shaders", "framebuffers", "renderbuffers", "queries" };
+
+	struct ObjectStats
+	{
+		int count = 0;
+		size_t bytes = 0;
+	};
+
+	struct OwnerStats
+	{
+		string name;
+		ObjectStats categories[GL_OBJECT_CATEGORY_COUNT];
+	};
+
+	// created on first use and never destroyed, wrappers in other files' statics may outlive anything
+	// declared here
+	struct Registry
+	{
+		vector<OwnerStats> owners;		// owner 0 collects objects created outside any scope
+		int currentOwner = 0;
+		bool contextAlive = true;
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry* registry = NULL;
+		if (registry == NULL)
+		{
+			registry = new Registry();
+			registry->owners.resize(1);
+			registry->owners[0].name = "unowned";
+		}
+		return *registry;
+	}
+
+	int FindOwner(const char* owner_name)
+	{
+		Registry& registry = GetRegistry();
+		for (size_t i = 0; i < registry.owners.size(); i++)
+		{
+			if (registry.owners[i].name == owner_name)
+				return (int)i;
+		}
+		registry.owners.push_back(OwnerStats());
+		registry.owners.back().name = owner_name;
+		return (int)registry.owners.size() - 1;
+	}
+
+	bool PrintOwners(bool live_only)
+	{
+		Registry& registry = GetRegistry();
+		bool any = false;
+		for (size_t i = 0; i < registry.owners.size(); i++)
+		{
+			const OwnerStats& owner = registry.owners[i];
+			int count = 0;
+			size_t bytes = 0;
+			for (int c = 0; c < GL_OBJECT_CATEGORY_COUNT; c++)
+			{
+				count += owner.categories[c].count;
+				bytes += owner.categories[c].bytes;
+			}
+			if (live_only && count == 0)
+				continue;
+
+			printf("  %-40s %6d objects %10.2f MB:", owner.name.c_str(), count, bytes / 1048576.0);
+			for (int c = 0; c < GL_OBJECT_CATEGORY_COUNT; c++)
+			{
+				if (owner.categories[c].count > 0)
+					printf(" %d %s", owner.categories[c].count, CATEGORY_NAMES[c]);
+			}
+			printf("\n");
+			any = true;
+		}
+		return any;
+	}
+}
+
+GLuint CreateGLName(GLObjectCategory category, GLenum type)
+{
+	GLuint name = 0;
+	switch (category)
+	{
+	case GL_OBJECT_BUFFER: glGenBuffers(1, &name); break;
+	case GL_OBJECT_VERTEX_ARRAY: glGenVertexArrays(1, &name); break;
+	case GL_OBJECT_TEXTURE: glGenTextures(1, &name); break;
+	case GL_OBJECT_SAMPLER: glGenSamplers(1, &name); break;
+	case GL_OBJECT_PROGRAM: name = glCreateProgram(); break;
+	case GL_OBJECT_SHADER: name = glCreateShader(type); break;
+	case GL_OBJECT_FRAMEBUFFER: glGenFramebuffers(1, &name); break;
+	case GL_OBJECT_RENDERBUFFER: glGenRenderbuffers(1, &name); break;
+	case GL_OBJECT_QUERY: glGenQueries(1, &name); break;
+	default: break;
+	}
+	return name;
+}
+
+void DeleteGLName(GLObjectCategory category, GLuint name)
+{
+	if (!GetRegistry().contextAlive)
+		return;
+
+	ForgetGLName(category, name);
+	switch (category)
+	{
+	case GL_OBJECT_BUFFER: glDeleteBuffers(1, &name); break;
+	case GL_OBJECT_VERTEX_ARRAY: glDeleteVertexArrays(1, &name); break;
+	case GL_OBJECT_TEXTURE: glDeleteTextures(1, &name); break;
+	case GL_OBJECT_SAMPLER: glDeleteSamplers(1, &name); break;
+	case GL_OBJECT_PROGRAM: glDeleteProgram(name); break;
+	case GL_OBJECT_SHADER: glDeleteShader(name); break;
+	case GL_OBJECT_FRAMEBUFFER: glDeleteFramebuffers(1, &name); break;
+	case GL_OBJECT_RENDERBUFFER: glDeleteRenderbuffers(1, &name); break;
+	case GL_OBJECT_QUERY: glDeleteQueries(1, &name); break;
+	default: break;
+	}
+}
+
+int TrackGLObject(GLObjectCategory category)
+{
+	Registry& registry = GetRegistry();
+	registry.owners[registry.currentOwner].categories[category].count++;
+	return registry.currentOwner;
+}
+
+void UntrackGLObject(GLObjectCategory category, int owner, size_t bytes)
+{
+	ObjectStats& stats = GetRegistry().owners[owner].categories[category];
+	stats.count--;
+	stats.bytes -= bytes;
+}
+
+void ResizeGLObject(GLObjectCategory category, int owner, size_t old_bytes, size_t new_bytes)
+{
+	ObjectStats& stats = GetRegistry().owners[owner].categories[category];
+	stats.bytes = stats.bytes - old_bytes + new_bytes;
+}
+
+GLOwnerScope::GLOwnerScope(const char* owner_name)
+{
+	previous = GetRegistry().currentOwner;
+	GetRegistry().currentOwner = FindOwner(owner_name);
+}
+
+GLOwnerScope::GLOwnerScope(int owner)
+{
+	previous = GetRegistry().currentOwner;
+	GetRegistry().currentOwner = owner;
+}
+
+GLOwnerScope::~GLOwnerScope()
+{
+	GetRegistry().currentOwner = previous;
+}
+
+int CurrentGLOwner()
+{
+	return GetRegistry().currentOwner;
+}
+
+void GetGLObjectStats(GLObjectCategory category, int& count, size_t& bytes)
+{
+	Registry& registry = GetRegistry();
+	count = 0;
+	bytes = 0;
+	for (size_t i = 0; i < registry.owners.size(); i++)
+	{
+		count += registry.owners[i].categories[category].count;
+		bytes += registry.owners[i].categories[category].bytes;
+	}
+}
+
+void PrintGLObjectReport()
+{
+	cout << "GL objects by category:" << endl;
+	for (int c = 0; c < GL_OBJECT_CATEGORY_COUNT; c++)
+	{
+		int count;
+		size_t bytes;
+		GetGLObjectStats((GLObjectCategory)c, count, bytes);
+		printf("  %-40s %6d objects %10.2f MB\n", CATEGORY_NAMES[c], count, bytes / 1048576.0);
+	}
+	cout << "GL objects by owner:" << endl;
+	PrintOwners(false);
+}
+
+void ShutdownGLObjects()
+{
+	cout << "GL objects alive at shutdown:" << endl;
+	if (!PrintOwners(true))
+		cout << "  none" << endl;
+	GetRegistry().contextAlive = false;
+}
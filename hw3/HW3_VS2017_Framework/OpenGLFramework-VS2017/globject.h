@@ -0,0 +1,136 @@
+#ifndef GL_OBJECT_H
+#define GL_OBJECT_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+// Owning wrappers for GL objects
+// A GLObject holds one object name: Create makes a new object (deleting the one held before), and
+// the object is deleted when the wrapper is reset or destroyed. Wrappers can be moved but not copied,
+// so every object has exactly one owner and cannot be forgotten.
+// A registry counts the live objects of each category, together with the GPU bytes their code reports
+// through SetBytes, for every owner: the model or subsystem named by the GLOwnerScope that was active
+// when the object was created. Leaks and memory growth show up in the report instead of in VRAM.
+
+enum GLObjectCategory
+{
+	GL_OBJECT_BUFFER = 0,
+	GL_OBJECT_VERTEX_ARRAY,
+	GL_OBJECT_TEXTURE,
+	GL_OBJECT_SAMPLER,
+	GL_OBJECT_PROGRAM,
+	GL_OBJECT_SHADER,
+	GL_OBJECT_FRAMEBUFFER,
+	GL_OBJECT_RENDERBUFFER,
+	GL_OBJECT_QUERY,
+	GL_OBJECT_CATEGORY_COUNT
+};
+
+// Registry side of the wrappers; the Track functions return the owner the object is counted for
+GLuint CreateGLName(GLObjectCategory category, GLenum type);
+void DeleteGLName(GLObjectCategory category, GLuint name);
+int TrackGLObject(GLObjectCategory category);
+void UntrackGLObject(GLObjectCategory category, int owner, size_t bytes);
+void ResizeGLObject(GLObjectCategory category, int owner, size_t old_bytes, size_t new_bytes);
+
+template <GLObjectCategory Category>
+class GLObject
+{
+public:
+	GLObject() : name(0), bytes(0), owner(0) {}
+	~GLObject() { Reset(); }
+
+	GLObject(GLObject&& other) noexcept : name(other.name), bytes(other.bytes), owner(other.owner)
+	{
+		other.name = 0;
+		other.bytes = 0;
+	}
+
+	GLObject& operator=(GLObject&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			name = other.name;
+			bytes = other.bytes;
+			owner = other.owner;
+			other.name = 0;
+			other.bytes = 0;
+		}
+		return *this;
+	}
+
+	GLObject(const GLObject&) = delete;
+	GLObject& operator=(const GLObject&) = delete;
+
+	// type is the shader type for shaders and ignored otherwise
+	void Create(GLenum type = 0)
+	{
+		Reset();
+		name = CreateGLName(Category, type);
+		owner = TrackGLObject(Category);
+	}
+
+	void Reset()
+	{
+		if (name == 0)
+			return;
+		DeleteGLName(Category, name);
+		UntrackGLObject(Category, owner, bytes);
+		name = 0;
+		bytes = 0;
+	}
+
+	// GPU memory behind the object as far as its user knows, e.g. the size passed to glBufferData
+	void SetBytes(size_t new_bytes)
+	{
+		if (name == 0)
+			return;
+		ResizeGLObject(Category, owner, bytes, new_bytes);
+		bytes = new_bytes;
+	}
+
+	size_t Bytes() const { return bytes; }
+	GLuint Get() const { return name; }
+	operator GLuint() const { return name; }
+
+private:
+	GLuint name;
+	size_t bytes;
+	int owner;
+};
+
+typedef GLObject<GL_OBJECT_BUFFER> GLBuffer;
+typedef GLObject<GL_OBJECT_VERTEX_ARRAY> GLVertexArray;
+typedef GLObject<GL_OBJECT_TEXTURE> GLTexture;
+typedef GLObject<GL_OBJECT_SAMPLER> GLSampler;
+typedef GLObject<GL_OBJECT_PROGRAM> GLProgram;
+typedef GLObject<GL_OBJECT_SHADER> GLShader;
+typedef GLObject<GL_OBJECT_FRAMEBUFFER> GLFramebuffer;
+typedef GLObject<GL_OBJECT_RENDERBUFFER> GLRenderbuffer;
+typedef GLObject<GL_OBJECT_QUERY> GLQuery;
+
+// Objects created while the scope lives are counted for its owner; scopes nest
+class GLOwnerScope
+{
+public:
+	explicit GLOwnerScope(const char* owner_name);
+	explicit GLOwnerScope(int owner);
+	~GLOwnerScope();
+
+private:
+	int previous;
+};
+
+// Owner new objects are counted for right now, to attribute objects created later to the same owner
+int CurrentGLOwner();
+
+// Live objects and bytes of a category, over all owners
+void GetGLObjectStats(GLObjectCategory category, int& count, size_t& bytes);
+// Live objects and bytes per category and per owner
+void PrintGLObjectReport();
+// Report whatever is still alive and stop calling GL: the context is about to go away, so wrappers
+// destroyed after this only leave the registry
+void ShutdownGLObjects();
+
+#endif
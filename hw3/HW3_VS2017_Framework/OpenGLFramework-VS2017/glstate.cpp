@@ -0,0 +1,284 @@
+#include <vector>
+#include <unordered_map>
+#include <string.h>
+#include "glstate.h"
+
+using namespace std;
+
+namespace
+{
+	const GLuint UNKNOWN = ~0u;
+	const int MAX_UNITS = 32;
+	const int MAX_UNIFORM_BINDINGS = 16;
+	const GLenum TEXTURE_TARGETS[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP };
+	const int TARGET_COUNT = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+	// zero is GL's initial state for all of them
+	GLuint currentProgram = 0;
+	GLuint currentVertexArray = 0;
+	GLuint arrayBuffer = 0;
+	GLuint drawIndirectBuffer = 0;
+	GLuint activeUnit = 0;
+	GLuint textures[MAX_UNITS][TARGET_COUNT];
+	GLuint samplers[MAX_UNITS];
+	GLuint uniformBuffers[MAX_UNIFORM_BINDINGS];
+
+	// last value uploaded to each uniform location
+	struct UniformValue
+	{
+		int size = 0;	// bytes in data, 0 while unknown
+		unsigned char data[16 * sizeof(GLfloat)];
+	};
+	unordered_map<GLuint, vector<UniformValue>> programUniforms;
+
+	int issuedCalls = 0;
+	int skippedCalls = 0;
+	int lastIssued = 0;
+	int lastSkipped = 0;
+
+	// Shadow compare for bindings, true when the call has to go to GL
+	bool Changed(GLuint& shadow, GLuint value)
+	{
+		if (shadow == value)
+		{
+			skippedCalls++;
+			return false;
+		}
+		shadow = value;
+		issuedCalls++;
+		return true;
+	}
+
+	// Shadow compare for a uniform of the current program
+	bool UniformChanged(GLint location, const void* data, int size)
+	{
+		if (location < 0)
+		{
+			skippedCalls++;
+			return false;
+		}
+		// without a known program there is nothing to compare against
+		if (currentProgram == UNKNOWN)
+		{
+			issuedCalls++;
+			return true;
+		}
+
+		vector<UniformValue>& values = programUniforms[currentProgram];
+		if ((size_t)location >= values.size())
+			values.resize(location + 1);
+		UniformValue& value = values[location];
+		if (value.size == size && memcmp(value.data, data, size) == 0)
+		{
+			skippedCalls++;
+			return false;
+		}
+		value.size = size;
+		memcpy(value.data, data, size);
+		issuedCalls++;
+		return true;
+	}
+
+	int TargetSlot(GLenum target)
+	{
+		for (int i = 0; i < TARGET_COUNT; i++)
+		{
+			if (TEXTURE_TARGETS[i] == target)
+				return i;
+		}
+		return -1;
+	}
+}
+
+void SetProgram(GLuint program)
+{
+	if (Changed(currentProgram, program))
+		glUseProgram(program);
+}
+
+void SetVertexArray(GLuint vao)
+{
+	if (Changed(currentVertexArray, vao))
+		glBindVertexArray(vao);
+}
+
+void SetBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ARRAY_BUFFER)
+	{
+		if (Changed(arrayBuffer, buffer))
+			glBindBuffer(target, buffer);
+	}
+	else if (target == GL_DRAW_INDIRECT_BUFFER)
+	{
+		if (Changed(drawIndirectBuffer, buffer))
+			glBindBuffer(target, buffer);
+	}
+	else
+	{
+		glBindBuffer(target, buffer);
+		issuedCalls++;
+	}
+}
+
+void SetTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	int slot = TargetSlot(target);
+	if (unit >= MAX_UNITS || slot < 0)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		activeUnit = unit;
+		issuedCalls += 2;
+		return;
+	}
+
+	if (textures[unit][slot] == texture)
+	{
+		skippedCalls++;
+		return;
+	}
+	if (Changed(activeUnit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+	textures[unit][slot] = texture;
+	glBindTexture(target, texture);
+	issuedCalls++;
+}
+
+void SetSampler(GLuint unit, GLuint sampler)
+{
+	if (unit >= MAX_UNITS)
+	{
+		glBindSampler(unit, sampler);
+		issuedCalls++;
+	}
+	else if (Changed(samplers[unit], sampler))
+		glBindSampler(unit, sampler);
+}
+
+void SetUniformBuffer(GLuint binding, GLuint buffer)
+{
+	if (binding >= MAX_UNIFORM_BINDINGS)
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+		issuedCalls++;
+	}
+	else if (Changed(uniformBuffers[binding], buffer))
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+}
+
+void SetUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (binding < MAX_UNIFORM_BINDINGS)
+		uniformBuffers[binding] = UNKNOWN;
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+	issuedCalls++;
+}
+
+void SetUniform1i(GLint location, GLint value)
+{
+	if (UniformChanged(location, &value, sizeof(value)))
+		glUniform1i(location, value);
+}
+
+void SetUniform1f(GLint location, GLfloat value)
+{
+	if (UniformChanged(location, &value, sizeof(value)))
+		glUniform1f(location, value);
+}
+
+void SetUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+{
+	GLfloat value[3] = { x, y, z };
+	if (UniformChanged(location, value, sizeof(value)))
+		glUniform3fv(location, 1, value);
+}
+
+void SetUniform3fv(GLint location, const GLfloat* value)
+{
+	if (UniformChanged(location, value, 3 * sizeof(GLfloat)))
+		glUniform3fv(location, 1, value);
+}
+
+void SetUniformMatrix4fv(GLint location, const GLfloat* value)
+{
+	if (UniformChanged(location, value, 16 * sizeof(GLfloat)))
+		glUniformMatrix4fv(location, 1, GL_FALSE, value);
+}
+
+void InvalidateGLBindings()
+{
+	currentProgram = UNKNOWN;
+	currentVertexArray = UNKNOWN;
+	arrayBuffer = UNKNOWN;
+	drawIndirectBuffer = UNKNOWN;
+	activeUnit = UNKNOWN;
+	for (int i = 0; i < MAX_UNITS; i++)
+	{
+		for (int j = 0; j < TARGET_COUNT; j++)
+			textures[i][j] = UNKNOWN;
+		samplers[i] = UNKNOWN;
+	}
+	for (int i = 0; i < MAX_UNIFORM_BINDINGS; i++)
+		uniformBuffers[i] = UNKNOWN;
+}
+
+void ForgetGLName(GLObjectCategory category, GLuint name)
+{
+	switch (category)
+	{
+	case GL_OBJECT_PROGRAM:
+		if (currentProgram == name)
+			currentProgram = UNKNOWN;
+		programUniforms.erase(name);
+		break;
+	case GL_OBJECT_VERTEX_ARRAY:
+		if (currentVertexArray == name)
+			currentVertexArray = UNKNOWN;
+		break;
+	case GL_OBJECT_BUFFER:
+		if (arrayBuffer == name)
+			arrayBuffer = UNKNOWN;
+		if (drawIndirectBuffer == name)
+			drawIndirectBuffer = UNKNOWN;
+		for (int i = 0; i < MAX_UNIFORM_BINDINGS; i++)
+		{
+			if (uniformBuffers[i] == name)
+				uniformBuffers[i] = UNKNOWN;
+		}
+		break;
+	case GL_OBJECT_TEXTURE:
+		for (int i = 0; i < MAX_UNITS; i++)
+		{
+			for (int j = 0; j < TARGET_COUNT; j++)
+			{
+				if (textures[i][j] == name)
+					textures[i][j] = UNKNOWN;
+			}
+		}
+		break;
+	case GL_OBJECT_SAMPLER:
+		for (int i = 0; i < MAX_UNITS; i++)
+		{
+			if (samplers[i] == name)
+				samplers[i] = UNKNOWN;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void EndGLStateFrame()
+{
+	lastIssued = issuedCalls;
+	lastSkipped = skippedCalls;
+	issuedCalls = 0;
+	skippedCalls = 0;
+}
+
+void GetGLStateStats(int& issued, int& skipped)
+{
+	issued = lastIssued;
+	skipped = lastSkipped;
+}
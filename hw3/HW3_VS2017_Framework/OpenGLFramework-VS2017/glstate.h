@@ -0,0 +1,45 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+#include "globject.h"
+
+// GL state tracker
+// Thin wrappers over the binding and uniform calls the renderer issues every frame. Each one keeps a
+// shadow copy of what it last set and skips the GL call when the value is unchanged; uniform values
+// are remembered per program, so they also survive program switches and frames.
+// The shadow state lasts across frames. Code that binds one of the tracked targets behind the
+// tracker's back must be followed by InvalidateGLBindings. Uniforms must only be set through the
+// tracker for programs it manages.
+
+void SetProgram(GLuint program);
+void SetVertexArray(GLuint vao);
+// Bind a buffer to GL_ARRAY_BUFFER or GL_DRAW_INDIRECT_BUFFER; other targets go straight to GL
+void SetBuffer(GLenum target, GLuint buffer);
+// Bind texture to target on unit, switching the active unit only when needed
+void SetTexture(GLuint unit, GLenum target, GLuint texture);
+void SetSampler(GLuint unit, GLuint sampler);
+// Bind a whole buffer to an indexed uniform block binding point
+void SetUniformBuffer(GLuint binding, GLuint buffer);
+// Bind part of a buffer; ranges of per-frame data differ every time, so this always goes to GL
+void SetUniformBufferRange(GLuint binding, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+// Uniforms of the program set with SetProgram
+void SetUniform1i(GLint location, GLint value);
+void SetUniform1f(GLint location, GLfloat value);
+void SetUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+void SetUniform3fv(GLint location, const GLfloat* value);
+// Column major, as glUniformMatrix4fv without transpose
+void SetUniformMatrix4fv(GLint location, const GLfloat* value);
+
+// Forget the shadowed bindings, the next Set call of each kind goes to GL
+void InvalidateGLBindings();
+// Called by the GLObject wrappers before deleting name: GL unbinds a deleted object and may hand
+// its name out again, so neither its bindings nor a program's uniform values may be kept
+void ForgetGLName(GLObjectCategory category, GLuint name);
+
+// Close the frame's counters; issued and skipped calls of the last closed frame
+void EndGLStateFrame();
+void GetGLStateStats(int& issued, int& skipped);
+
+#endif
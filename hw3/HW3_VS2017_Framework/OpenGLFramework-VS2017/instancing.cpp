@@ -0,0 +1,82 @@
+#include <iostream>
+#include <vector>
+#include <math.h>
+#include "instancing.h"
+#include "globject.h"
+#include "glstate.h"
+
+using namespace std;
+
+namespace
+{
+	GLBuffer instanceBuffer;
+	int instanceCount = 0;
+	int instanceCapacity = 0;
+}
+
+bool SetInstanceGrid(int count)
+{
+	count = count < 0 ? 0 : (count > MAX_INSTANCES ? MAX_INSTANCES : count);
+	instanceCount = count;
+	if (count == 0)
+		return true;
+
+	// copies sit in the centers of side x side cells, scaled down to leave a small gap
+	int side = (int)ceil(sqrt((double)count));
+	float cell = 2.0f / side;
+	vector<GLfloat> grid((size_t)count * 4);
+	for (int i = 0; i < count; i++)
+	{
+		grid[i * 4 + 0] = -1.0f + cell * (i % side + 0.5f);
+		grid[i * 4 + 1] = 1.0f - cell * (i / side + 0.5f);
+		grid[i * 4 + 2] = 0.0f;
+		grid[i * 4 + 3] = cell * 0.45f;
+	}
+
+	if (instanceBuffer == 0)
+	{
+		GLOwnerScope owner("stress grid");
+		instanceBuffer.Create();
+	}
+	SetBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	if (count > instanceCapacity)
+	{
+		glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(GLfloat), &grid[0], GL_STATIC_DRAW);
+		if (glGetError() == GL_OUT_OF_MEMORY)
+		{
+			cout << "SetInstanceGrid: Out of memory for " << count << " instances" << endl;
+			instanceCount = instanceCapacity = 0;
+			return false;
+		}
+		instanceCapacity = count;
+		instanceBuffer.SetBytes(grid.size() * sizeof(GLfloat));
+	}
+	else
+		glBufferSubData(GL_ARRAY_BUFFER, 0, grid.size() * sizeof(GLfloat), &grid[0]);
+	return true;
+}
+
+int GetInstanceCount()
+{
+	return instanceCount;
+}
+
+void EnableInstanceAttribute(int view_count)
+{
+	SetBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glVertexAttribPointer(INSTANCE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribDivisor(INSTANCE_ATTRIBUTE, view_count);
+	glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+}
+
+void DisableInstanceAttribute()
+{
+	glDisableVertexAttribArray(INSTANCE_ATTRIBUTE);
+	glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 0);
+}
+
+void DeleteInstanceGrid()
+{
+	instanceBuffer.Reset();
+	instanceCount = instanceCapacity = 0;
+}
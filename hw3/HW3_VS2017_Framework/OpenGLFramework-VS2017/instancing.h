@@ -0,0 +1,28 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+
+// Instanced stress grid
+// Draws N copies of the current model laid out on a square grid to measure how vertex and draw
+// throughput scale. Every copy is one vec4 of an instanced vertex attribute, grid offset in xyz and
+// uniform scale in w, applied in model space before the model matrix. With a uniform scale the
+// normal matrix stays the same for all copies. When the attribute array is disabled the shader
+// reads the default (0, 0, 0, 1), so regular draws need no special case.
+
+#define INSTANCE_ATTRIBUTE 4		// shader location of aInstance, right after the vertex attributes
+#define MAX_INSTANCES (1 << 20)
+
+// Lay count copies out on a grid covering the model's [-1, 1] square, 0 turns the grid off.
+// false if the instance buffer can not be allocated
+bool SetInstanceGrid(int count);
+int GetInstanceCount();
+
+// Point the bound vertex array at the grid. Every copy is drawn view_count times in a row, so
+// instance i of a draw reads grid entry i / view_count
+void EnableInstanceAttribute(int view_count);
+void DisableInstanceAttribute();
+
+void DeleteInstanceGrid();
+
+#endif
@@ -2,18 +2,33 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <set>
+#include <chrono>
 #include<math.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "textfile.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include <STB/stb_image.h>
+#include "texture.h"
+#include "mipfeedback.h"
 
 
 #include "Vectors.h"
 #include "Matrices.h"
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
+#include "normalbaker.h"
+#include "texturebench.h"
+#include "vertexformat.h"
+#include "mesharena.h"
+#include "glstate.h"
+#include "uniformblocks.h"
+#include "instancing.h"
+#include "drawindirect.h"
+#include "ringbuffer.h"
+#include "globject.h"
+#include "shadervariants.h"
+#include "glinfo.h"
 
 #ifndef max
 # define max(a,b) (((a)>(b))?(a):(b))
@@ -25,9 +40,18 @@ using namespace std;
 // Default window size
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
+// per-frame transforms and draw commands, a few hundred bytes per model
+const size_t RING_REGION_BYTES = 1 << 20;
 // current window size
 int screenWidth = WINDOW_WIDTH, screenHeight = WINDOW_HEIGHT;
 
+// event driven rendering: frames are only drawn while something changes
+bool event_driven = true;
+bool scene_dirty = true;	// set by the callbacks and model loads, cleared by the next frame
+int frames_drawn = 0;
+int idle_frames = 0;		// frames drawn although nothing visible changed, whatever woke the loop
+int event_waits = 0;
+
 bool mouse_pressed = false;
 int starting_press_x = -1;
 int starting_press_y = -1;
@@ -53,30 +77,37 @@ typedef struct
 	Vector3 Kd;
 	Vector3 Ks;
 	GLfloat shininess;
-	GLuint diffuseTexture;
+	int diffuseLayer;	// layer of the model's texture array
 } PhongMaterial;
 
 typedef struct
 {
-	GLuint vao;
-	GLuint vbo;
-	GLuint vboTex;
-	GLuint ebo;
-	GLuint p_color;
-	int vertex_count;
-	GLuint p_normal;
-	GLuint p_texCoord;
+	MeshRange mesh;	// vertices and indices inside the mesh arena
 	PhongMaterial material;
-	int indexCount;
+	int materialIndex;	// entry of the model's material buffer
 } Shape;
 
+// Consecutive shapes drawing with the same material, issued as one multi-draw
+typedef struct
+{
+	int materialIndex;
+	MeshBatch meshes;
+} MaterialBatch;
+
 struct model
 {
 	Vector3 position = Vector3(0, 0, 0);
 	Vector3 scale = Vector3(1, 1, 1);
 	Vector3 rotation = Vector3(0, 0, 0);	// Euler form
-	GLuint texNum;
 	vector<Shape> shapes;
+	TextureHandle textureArray;	// every diffuse map of the model, one layer each
+	GLBuffer materialBuffer;	// MaterialBlock with every material of the model
+	int materialCount;
+	bool materialsDirty;		// a shape's material changed since the last upload
+	vector<MaterialBatch> batches;	// shapes grouped by pool and material, rebuilt on load
+	int sourceDraws;			// draws the .obj shapes would take one material each
+	unsigned int vertexMask;	// vertex format of the shapes, picks the shader variant together with textured
+	bool textured;				// a material names a diffuse map
 };
 vector<model> models;
 
@@ -111,54 +142,35 @@ Matrix4 project_matrix;
 int cur_idx = 0; // represent which model should be rendered now
 vector<string> model_list{ "../TextureModels/Fushigidane.obj", "../TextureModels/Mew.obj","../TextureModels/Nyarth.obj","../TextureModels/Zenigame.obj", "../TextureModels/texturedknot.obj", "../TextureModels/laurana500.obj", "../TextureModels/Nala.obj" };
 
-GLuint program;
-
-
-// uniforms location
-GLuint iLocP;
-GLuint iLocV;
-GLuint iLocM;
-Matrix4 model_matrix;
+// attributes of every loaded mesh
+const unsigned int TEXTURED_VERTEX_MASK = 1 << ATTRIB_POSITION | 1 << ATTRIB_COLOR | 1 << ATTRIB_NORMAL | 1 << ATTRIB_TEXCOORD;
 
-Shape quad;
-Shape m_shape;
+// buffer layout of model vertices, the split layout is only kept for --bench-draw
+VertexLayout vertex_layout = LAYOUT_INTERLEAVED;
+// the .obj shapes of a model are merged per material at load, --no-merge keeps them apart
+bool merge_shapes = true;
+// copies of the model on the stress grid at startup, --instances N; [ and ] halve and double it
+int stress_instances = 0;
+// one glMultiDrawElementsIndirect per model where supported, --no-indirect keeps the batch loop
+bool indirect_draws = true;
 
-// Shader attributes for uniform variables
-GLuint iLocLightType;
-GLuint iLocKa;
-GLuint iLocKd;
-GLuint iLocKs;
-GLuint iLocShininess;
-GLint iLocMVP;
-
-void set_variables(GLuint p);
 void updateLight();
+void updateModelMaterials(model& m);
 void textureParameterHandler();
+void ReloadModel(int idx);
+long long CountTriangles(const model& m);
 bool light_edit = false;
+bool light_dirty = true;	// lightInfo, the toggles or the view changed since the light block was updated
 bool ambient_flag = true;
 bool diffuse_flag = true;
 bool specular_flag = true;
-int vertex_or_perpixel = 0;
+bool single_pass_views = true;	// draw both halves as two instances of one draw
 
 // texture filtering type
 bool mag_linear = true;
 bool min_linear = true;
 bool repeat = true;
 
-struct iLocLightInfo
-{
-	GLuint position;
-	GLuint ambient;
-	GLuint diffuse;
-	GLuint specular;
-	GLuint spotDirection;
-	GLuint spotCutoff;
-	GLuint spotExponent;
-	GLuint constantAttenuation;
-	GLuint linearAttenuation;
-	GLuint quadraticAttenuation;
-}iLocLightInfo[3];
-
 struct LightInfo
 {
 	//Vector3 position;
@@ -176,7 +188,9 @@ struct LightInfo
 	float constantAttenuation;
 	float linearAttenuation;
 	float quadraticAttenuation;
-}lightInfo[3];
+	int type;	// LightType, light_type picks which type is lit
+};
+vector<LightInfo> lightInfo(3);	// up to MAX_LIGHTS
 
 int light_type = 0;
 
@@ -302,6 +316,8 @@ void setViewingMatrix()
 	view_matrix[15] = 1;
 
 	view_matrix = view_matrix * translate(-main_camera.position);
+	// the light block holds view space lights
+	light_dirty = true;
 }
 
 void setOrthogonal()
@@ -362,6 +378,13 @@ void ChangeSize(GLFWwindow* window, int width, int height)
 
 	screenWidth = width;
 	screenHeight = height;
+	scene_dirty = true;
+}
+
+// Call back function for window exposure
+void window_refresh_callback(GLFWwindow* window)
+{
+	scene_dirty = true;
 }
 
 void Vector3ToFloat4(Vector3 v, GLfloat res[4])
@@ -373,11 +396,13 @@ void Vector3ToFloat4(Vector3 v, GLfloat res[4])
 }
 
 // Render function for display rendering
-void RenderScene(int per_vertex_or_per_pixel) {	
-	Vector3 modelPos = models[cur_idx].position;
-
-	//Update light
-	updateLight();
+void RenderScene(ShadingMode shading, int view_count = 1) {	
+	// light type, shading mode and texturing are compiled into the program instead of read from uniforms
+	ShaderKey key = { light_type, shading, models[cur_idx].textured, models[cur_idx].vertexMask };
+	const ShaderVariant* shader = GetShaderVariant(key);
+	if (shader == NULL)
+		return;
+	SetProgram(shader->program);
 
 	Matrix4 T, R, S;
 	T = translate(models[cur_idx].position);
@@ -386,7 +411,6 @@ void RenderScene(int per_vertex_or_per_pixel) {
 
 	Matrix4 MVP;
 	GLfloat mvp[16];
-	glUniform1i(iLocLightType, light_type);
 
 	MVP = project_matrix * view_matrix * T * R * S;
 	mvp[0] = MVP[0];  mvp[4] = MVP[1];   mvp[8] = MVP[2];    mvp[12] = MVP[3];
@@ -395,40 +419,91 @@ void RenderScene(int per_vertex_or_per_pixel) {
 	mvp[3] = MVP[12]; mvp[7] = MVP[13];  mvp[11] = MVP[14];   mvp[15] = MVP[15];
 
 	// render object
+	// per draw constants: the shaders get model-view and normal matrix ready made instead of
+	// deriving them for every vertex, all of them go to the ring buffer as one block
 	Matrix4 model_matrix = T * R * S;
-	glUniformMatrix4fv(iLocM, 1, GL_FALSE, model_matrix.getTranspose());
-	glUniformMatrix4fv(iLocV, 1, GL_FALSE, view_matrix.getTranspose());
-	glUniformMatrix4fv(iLocP, 1, GL_FALSE, project_matrix.getTranspose());
-	glUniformMatrix4fv(iLocMVP, 1, GL_FALSE, mvp);
-
-	for (int i = 0; i < models[cur_idx].shapes.size(); i++) 
+	Matrix4 model_view = view_matrix * model_matrix;
+	Matrix4 inverse_model_view = model_view;
+	inverse_model_view.invert();
+	TransformStd140 transforms;
+	memcpy(transforms.modelView, model_view.getTranspose(), sizeof(transforms.modelView));
+	// the normal matrix is the transposed inverse, so the row major inverse already is its column major form
+	memcpy(transforms.normalMatrix, inverse_model_view.get(), sizeof(transforms.normalMatrix));
+	memcpy(transforms.mvp, mvp, sizeof(transforms.mvp));
+	BindTransformBlock(transforms);
+
+	// [TODO] Bind texture and modify texture filtering & wrapping mode
+	// Hint: glActiveTexture, glBindTexture, glTexParameteri
+	// all shapes sample the same array, only the layer changes per material
+	SetTexture(0, GL_TEXTURE_2D_ARRAY, GetTextureObject(models[cur_idx].textureArray));
+
+	// a model's shapes share one vertex format, so one vertex array covers all of them
+	if (!models[cur_idx].shapes.empty())
+		BindMeshPool(models[cur_idx].shapes[0].mesh.pool);
+
+	// materials are bound once per model, each draw only picks its entry
+	if (models[cur_idx].materialsDirty)
+		updateModelMaterials(models[cur_idx]);
+	SetUniformBuffer(MATERIAL_BLOCK_BINDING, models[cur_idx].materialBuffer);
+
+	// baseInstance would offset the stress grid's attribute as well, so the grid keeps the batch loop
+	if (indirect_draws && IsDrawIndirectSupported() && GetInstanceCount() == 0)
 	{
-		glUniform3f(iLocKa, models[cur_idx].shapes[i].material.Ka[0], models[cur_idx].shapes[i].material.Ka[1], models[cur_idx].shapes[i].material.Ka[2]);
-		glUniform3f(iLocKd, models[cur_idx].shapes[i].material.Kd[0], models[cur_idx].shapes[i].material.Kd[1], models[cur_idx].shapes[i].material.Kd[2]);
-		glUniform3f(iLocKs, models[cur_idx].shapes[i].material.Ks[0], models[cur_idx].shapes[i].material.Ks[1], models[cur_idx].shapes[i].material.Ks[2]);
-		glUniform1f(iLocShininess, models[cur_idx].shapes[i].material.shininess);
-
-		glBindVertexArray(models[cur_idx].shapes[i].vao);
+		// every batch becomes commands of one buffer, the shader takes each command's material from aDrawMaterial
+		SetUniform1i(shader->materialIndex, -1);
+		BeginIndirectDraws(view_count);
+		for (size_t i = 0; i < models[cur_idx].batches.size(); i++)
+			AddIndirectDraws(models[cur_idx].batches[i].meshes, models[cur_idx].batches[i].materialIndex);
+		SubmitIndirectDraws();
+		return;
+	}
 
-		// [TODO] Bind texture and modify texture filtering & wrapping mode
-		// Hint: glActiveTexture, glBindTexture, glTexParameteri
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, models[cur_idx].shapes[i].material.diffuseTexture);
-		
-		// texture handler
-		textureParameterHandler();
-		glDrawArrays(GL_TRIANGLES, 0, models[cur_idx].shapes[i].vertex_count);
+	// the stress grid repeats every draw once per copy and view
+	int copies = max(GetInstanceCount(), 1);
+	if (GetInstanceCount() > 0)
+		EnableInstanceAttribute(view_count);
+	for (size_t i = 0; i < models[cur_idx].batches.size(); i++) 
+	{
+		SetUniform1i(shader->materialIndex, models[cur_idx].batches[i].materialIndex);
+		DrawMeshBatch(models[cur_idx].batches[i].meshes, view_count * copies);
 	}
+	if (GetInstanceCount() > 0)
+		DisableInstanceAttribute();
+}
+
+// Coverage pass for mip streaming: which mip of the model's textures one view actually needs
+void RenderMipFeedback()
+{
+	if (!BeginMipFeedback(screenWidth / 2, screenHeight))
+		return;
+
+	Matrix4 MVP = project_matrix * view_matrix * translate(models[cur_idx].position) * rotate(models[cur_idx].rotation) * scaling(models[cur_idx].scale);
+	SetMipFeedbackTexture(models[cur_idx].textureArray, MVP.getTranspose());
+	// coverage does not depend on the material, so every shape goes into one multi-draw
+	MeshBatch batch;
+	for (size_t i = 0; i < models[cur_idx].shapes.size(); i++)
+		AddMeshToBatch(batch, models[cur_idx].shapes[i].mesh);
+	BindMeshPool(batch.pool);
+	// the stress grid copies are what covers the screen, so they request the levels
+	if (GetInstanceCount() > 0)
+		EnableInstanceAttribute(1);
+	DrawMeshBatch(batch, max(GetInstanceCount(), 1));
+	if (GetInstanceCount() > 0)
+		DisableInstanceAttribute();
+
+	EndMipFeedback();
 }
 
 // Call back function for keyboard
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	if (action == GLFW_PRESS) {
+		scene_dirty = true;
 		switch (key)
 		{
 		case GLFW_KEY_ESCAPE:
-			exit(0);
+			// leave through the end of main, which stops the decode threads before static destruction
+			glfwSetWindowShouldClose(window, GLFW_TRUE);
 			break;
 		case GLFW_KEY_Z:
 			cur_idx = (cur_idx + 1) % model_list.size();
@@ -477,7 +552,31 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 			cout << "Viewing Matrix :" << endl << view_matrix;
 			cout << "Projection Matrix :" << endl << project_matrix;
 			cout << "Light Mode: " << light_type << endl;
+			cout << "Shader variants built: " << GetShaderVariantCount() << endl;
 			cout << "shininess: " << models[cur_idx].shapes[0].material.shininess << endl;
+			{
+				int issued, skipped;
+				GetGLStateStats(issued, skipped);
+				cout << "GL calls last frame: " << issued << " issued, " << skipped << " redundant skipped" << endl;
+				cout << "Draw calls per view: " << models[cur_idx].batches.size() << " batched, " << models[cur_idx].sourceDraws << " from the .obj shapes";
+				cout << (indirect_draws && IsDrawIndirectSupported() && GetInstanceCount() == 0 ? ", submitted as one multi-draw-indirect" : "") << endl;
+				if (GetInstanceCount() > 0)
+					cout << "Stress grid: " << GetInstanceCount() << " copies, " << GetInstanceCount() * CountTriangles(models[cur_idx]) << " triangles per view" << endl;
+				int ring_stalls;
+				size_t ring_bytes;
+				GetRingStats(ring_stalls, ring_bytes);
+				cout << "Ring buffer: " << ring_bytes << " bytes last frame, " << ring_stalls << " stalls, " << (IsRingPersistent() ? "persistent" : "orphaned") << endl;
+				cout << "Frames drawn: " << frames_drawn << ", idle frames: " << idle_frames << ", event waits: " << event_waits << endl;
+				PrintGLObjectReport();
+			}
+			break;
+		case GLFW_KEY_RIGHT_BRACKET:
+			SetInstanceGrid(GetInstanceCount() == 0 ? 1 : GetInstanceCount() * 2);
+			cout << "Stress grid: " << GetInstanceCount() << " copies" << endl;
+			break;
+		case GLFW_KEY_LEFT_BRACKET:
+			SetInstanceGrid(GetInstanceCount() / 2);
+			cout << "Stress grid: " << GetInstanceCount() << " copies" << endl;
 			break;
 		case GLFW_KEY_L:
 			light_type += 1;
@@ -496,14 +595,17 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		case GLFW_KEY_A:
 			cur_trans_mode = LightEdit;
 			ambient_flag = !ambient_flag;
+			light_dirty = true;
 			break;
 		case GLFW_KEY_D:
 			cur_trans_mode = LightEdit;
 			diffuse_flag = !diffuse_flag;
+			light_dirty = true;
 			break;
 		case GLFW_KEY_N:
 			cur_trans_mode = LightEdit;
 			specular_flag = !specular_flag;
+			light_dirty = true;
 			break;
 		case GLFW_KEY_G:
 			mag_linear = !mag_linear;
@@ -514,6 +616,9 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		case GLFW_KEY_V:
 			repeat = !repeat;
 			break;
+		case GLFW_KEY_F5:
+			ReloadModel(cur_idx);
+			break;
 		default:
 			break;
 		}
@@ -523,6 +628,7 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	// scroll up positive, otherwise it would be negtive
+	scene_dirty = true;
 	switch (cur_trans_mode)
 	{
 	case ViewEye:
@@ -588,6 +694,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 				lightInfo[2].spotCutoff -= 0.005;
 			}
 		}
+		light_dirty = true;
 		break;
 	case Shine:
 		if (yoffset > 0)
@@ -602,6 +709,8 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 				for (int j = 0; j < models[i].shapes.size(); j++)
 					models[i].shapes[j].material.shininess -= 5;
 		}
+		for (int i = 0; i < 7; i++)
+			models[i].materialsDirty = true;
 		break;
 	}
 }
@@ -630,6 +739,7 @@ static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 			float diff_y = starting_press_y - (int)ypos;
 			starting_press_x = (int)xpos;
 			starting_press_y = (int)ypos;
+			scene_dirty = true;
 			switch (cur_trans_mode)
 			{
 			case ViewEye:
@@ -669,6 +779,7 @@ static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 				lightInfo[1].position[1] -= diff_y * 0.0025;
 				lightInfo[2].position[0] += diff_x * 0.0025;
 				lightInfo[2].position[1] -= diff_y * 0.0025;
+				light_dirty = true;
 				break;
 			}
 		}
@@ -677,74 +788,13 @@ static void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 
 void setShaders()
 {
-	GLuint v, f, p;
-	char *vs = NULL;
-	char *fs = NULL;
-
-	v = glCreateShader(GL_VERTEX_SHADER);
-	f = glCreateShader(GL_FRAGMENT_SHADER);
-
-	vs = textFileRead("shader.vs.glsl");
-	fs = textFileRead("shader.fs.glsl");
-
-	glShaderSource(v, 1, (const GLchar**)&vs, NULL);
-	glShaderSource(f, 1, (const GLchar**)&fs, NULL);
-
-	free(vs);
-	free(fs);
-
-	GLint success;
-	char infoLog[1000];
-	// compile vertex shader
-	glCompileShader(v);
-	// check for shader compile errors
-	glGetShaderiv(v, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(v, 1000, NULL, infoLog);
-		std::cout << "ERROR: VERTEX SHADER COMPILATION FAILED\n" << infoLog << std::endl;
-	}
-
-	// compile fragment shader
-	glCompileShader(f);
-	// check for shader compile errors
-	glGetShaderiv(f, GL_COMPILE_STATUS, &success);
-	if (!success)
+	// every variant of the loaded vertex format is built up front: a broken shader still stops the
+	// program at startup, and changing the light type or view mode never compiles mid-frame
+	if (!PrecompileShaderVariants(TEXTURED_VERTEX_MASK))
 	{
-		glGetShaderInfoLog(f, 1000, NULL, infoLog);
-		std::cout << "ERROR: FRAGMENT SHADER COMPILATION FAILED\n" << infoLog << std::endl;
-	}
-
-	// create program object
-	p = glCreateProgram();
-
-	// attach shaders to program object
-	glAttachShader(p,f);
-	glAttachShader(p,v);
-
-	// link program
-	glLinkProgram(p);
-	// check for linking errors
-	glGetProgramiv(p, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(p, 1000, NULL, infoLog);
-		std::cout << "ERROR: SHADER PROGRAM LINKING FAILED\n" << infoLog << std::endl;
+		system("pause");
+		exit(123);
 	}
-
-	glDeleteShader(v);
-	glDeleteShader(f);
-
-	set_variables(p);
-
-	if (success)
-		glUseProgram(p);
-    else
-    {
-        system("pause");
-        exit(123);
-    }
-
-	program = p;
 }
 
 void normalization(tinyobj::attrib_t* attrib, vector<GLfloat>& vertices, vector<GLfloat>& colors, vector<GLfloat>& normals, vector<GLfloat>& textureCoords, vector<int>& material_id, tinyobj::shape_t* shape)
@@ -877,36 +927,9 @@ static string GetBaseDir(const string& filepath) {
 	return "";
 }
 
-GLuint LoadTextureImage(string image_path)
-{
-	int channel, width, height;
-	int require_channel = 4;
-	stbi_set_flip_vertically_on_load(true);
-	stbi_uc *data = stbi_load(image_path.c_str(), &width, &height, &channel, require_channel);
-	if (data != NULL)
-	{
-		GLuint tex = 0;
-
-		// [TODO] Bind the image to texture
-		// Hint: glGenTextures, glBindTexture, glTexImage2D, glGenerateMipmap
-		glGenTextures(1, &tex);
-		glBindTexture(GL_TEXTURE_2D, tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		// free the image from memory after binding to texture
-		stbi_image_free(data);
-		return tex; 
-	}
-	else
-	{
-		cout << "LoadTextureImage: Cannot load image from " << image_path << endl;
-		return -1;
-	}
-}
-
 vector<Shape> SplitShapeByMaterial(vector<GLfloat>& vertices, vector<GLfloat>& colors, vector<GLfloat>& normals, vector<GLfloat>& textureCoords, vector<int>& material_id, vector<PhongMaterial>& materials)
 {
+	VertexFormat textured_format = MakeVertexFormat(TEXTURED_VERTEX_MASK);
 	vector<Shape> res;
 	for (int m = 0; m < materials.size(); m++)
 	{
@@ -935,37 +958,21 @@ vector<Shape> SplitShapeByMaterial(vector<GLfloat>& vertices, vector<GLfloat>& c
 
 		if (!m_vertices.empty())
 		{
+			// shared vertices of the triangle soup are merged and drawn through an index buffer
+			const GLfloat* streams[ATTRIB_COUNT] = { &m_vertices[0], &m_colors[0], &m_normals[0], &m_textureCoords[0] };
+			vector<GLfloat> interleaved;
+			vector<GLuint> indices;
+			InterleaveVertices(textured_format, streams, (int)(m_vertices.size() / 3), interleaved);
+			int vertex_count = WeldVertices(textured_format, interleaved, indices);
+
 			Shape tmp_shape;
-			glGenVertexArrays(1, &tmp_shape.vao);
-			glBindVertexArray(tmp_shape.vao);
-
-			glGenBuffers(1, &tmp_shape.vbo);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.vbo);
-			glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(GL_FLOAT), &m_vertices.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-			tmp_shape.vertex_count = m_vertices.size() / 3;
-
-			glGenBuffers(1, &tmp_shape.p_color);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_color);
-			glBufferData(GL_ARRAY_BUFFER, m_colors.size() * sizeof(GL_FLOAT), &m_colors.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-			glGenBuffers(1, &tmp_shape.p_normal);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_normal);
-			glBufferData(GL_ARRAY_BUFFER, m_normals.size() * sizeof(GL_FLOAT), &m_normals.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-			glGenBuffers(1, &tmp_shape.p_texCoord);
-			glBindBuffer(GL_ARRAY_BUFFER, tmp_shape.p_texCoord);
-			glBufferData(GL_ARRAY_BUFFER, m_textureCoords.size() * sizeof(GL_FLOAT), &m_textureCoords.at(0), GL_STATIC_DRAW);
-			glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-			glEnableVertexAttribArray(0);
-			glEnableVertexAttribArray(1);
-			glEnableVertexAttribArray(2);
-			glEnableVertexAttribArray(3);
+			if (!AllocateMesh(textured_format, vertex_layout, &interleaved[0], vertex_count, &indices[0], (int)indices.size(), tmp_shape.mesh))
+				continue;
 
 			tmp_shape.material = materials[m];
+			// the material block holds MAX_MATERIALS entries, the shaders must never index past it;
+			// the surplus materials share the last entry, LoadTexturedModels reports them
+			tmp_shape.materialIndex = min(m, MAX_MATERIALS - 1);
 			res.push_back(tmp_shape);
 		}
 	}
@@ -973,6 +980,43 @@ vector<Shape> SplitShapeByMaterial(vector<GLfloat>& vertices, vector<GLfloat>& c
 	return res;
 }
 
+// Group the shapes by pool and material so every group is one draw call. The sort is stable,
+// shapes keep their load order inside a group
+void BuildDrawBatches(model& m)
+{
+	vector<int> order(m.shapes.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = (int)i;
+	stable_sort(order.begin(), order.end(), [&](int a, int b)
+	{
+		if (m.shapes[a].mesh.pool != m.shapes[b].mesh.pool)
+			return m.shapes[a].mesh.pool < m.shapes[b].mesh.pool;
+		return m.shapes[a].materialIndex < m.shapes[b].materialIndex;
+	});
+
+	m.batches.clear();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Shape& shape = m.shapes[order[i]];
+		if (m.batches.empty() || m.batches.back().materialIndex != shape.materialIndex || m.batches.back().meshes.pool != shape.mesh.pool)
+		{
+			MaterialBatch batch;
+			batch.materialIndex = shape.materialIndex;
+			m.batches.push_back(batch);
+		}
+		AddMeshToBatch(m.batches.back().meshes, shape.mesh);
+	}
+}
+
+// Triangles one copy of the model draws
+long long CountTriangles(const model& m)
+{
+	long long triangles = 0;
+	for (size_t i = 0; i < m.shapes.size(); i++)
+		triangles += m.shapes[i].mesh.indexCount / 3;
+	return triangles;
+}
+
 void LoadTexturedModels(string model_path)
 {
 	vector<tinyobj::shape_t> shapes;
@@ -1006,13 +1050,19 @@ void LoadTexturedModels(string model_path)
 	}
 
 	if (!ret) {
+		ShutdownTextureStreaming();
 		exit(1);
 	}
 
 	printf("Load Models Success ! Shapes size %d Material size %d\n", shapes.size(), materials.size());
+	// the model's GL objects, textures included, are counted under its path
+	GLOwnerScope owner(model_path.c_str());
 	model tmp_model;
+	tmp_model.vertexMask = TEXTURED_VERTEX_MASK;
+	tmp_model.textured = false;
 
 	vector<PhongMaterial> allMaterial;
+	vector<string> texturePaths;	// one array layer per distinct diffuse map
 	for (int i = 0; i < materials.size(); i++)
 	{
 		PhongMaterial material;
@@ -1020,27 +1070,48 @@ void LoadTexturedModels(string model_path)
 		material.Kd = Vector3(materials[i].diffuse[0], materials[i].diffuse[1], materials[i].diffuse[2]);
 		material.Ks = Vector3(materials[i].specular[0], materials[i].specular[1], materials[i].specular[2]);
 
-		material.diffuseTexture = LoadTextureImage(base_dir + string(materials[i].diffuse_texname));
-		if (material.diffuseTexture == -1)
-		{
-			cout << "LoadTexturedModels: Fail to load model's material " << i << endl;
-			system("pause");
-			
-		}
+		string path = base_dir + string(materials[i].diffuse_texname);
+		material.diffuseLayer = (int)(find(texturePaths.begin(), texturePaths.end(), path) - texturePaths.begin());
+		if (material.diffuseLayer == (int)texturePaths.size())
+			texturePaths.push_back(path);
+		if (!materials[i].diffuse_texname.empty())
+			tmp_model.textured = true;
 		
 		allMaterial.push_back(material);
 	}
+
+	tmp_model.textureArray = texturePaths.empty() ? -1 : AcquireTextureArray(texturePaths);
+	tmp_model.materialBuffer = CreateMaterialBuffer();
+	tmp_model.materialCount = min((int)allMaterial.size(), MAX_MATERIALS);
+	if (allMaterial.size() > MAX_MATERIALS)
+		cout << "LoadTexturedModels: " << allMaterial.size() << " materials, the ones past " << MAX_MATERIALS << " are drawn with material " << MAX_MATERIALS - 1 << endl;
+	tmp_model.materialsDirty = true;
+	if (tmp_model.textureArray == (TextureHandle)-1 && !texturePaths.empty())
+	{
+		cout << "LoadTexturedModels: Fail to load model's materials" << endl;
+		system("pause");
+	}
 	
+	tmp_model.sourceDraws = 0;
 	for (int i = 0; i < shapes.size(); i++)
 	{
-		vertices.clear();
-		colors.clear();
-		normals.clear();
-		textureCoords.clear();
-		material_id.clear();
+		set<int> shape_materials(shapes[i].mesh.material_ids.begin(), shapes[i].mesh.material_ids.end());
+		tmp_model.sourceDraws += (int)shape_materials.size();
+
+		// when merging, the vertices of all shapes are collected and split by material once
+		if (!merge_shapes || i == 0)
+		{
+			vertices.clear();
+			colors.clear();
+			normals.clear();
+			textureCoords.clear();
+			material_id.clear();
+		}
 
 		normalization(&attrib, vertices, colors, normals, textureCoords, material_id, &shapes[i]);
 		// printf("Vertices size: %d", vertices.size() / 3);
+		if (merge_shapes && (size_t)i + 1 < shapes.size())
+			continue;
 
 		// split current shape into multiple shapes base on material_id.
 		vector<Shape> splitedShapeByMaterial = SplitShapeByMaterial(vertices, colors, normals, textureCoords, material_id, allMaterial);
@@ -1048,9 +1119,58 @@ void LoadTexturedModels(string model_path)
 		// concatenate splited shape to model's shape list
 		tmp_model.shapes.insert(tmp_model.shapes.end(), splitedShapeByMaterial.begin(), splitedShapeByMaterial.end());
 	}
+	BuildDrawBatches(tmp_model);
+	printf("Draw calls: %d from the .obj shapes, %d meshes, %d batched\n", tmp_model.sourceDraws, (int)tmp_model.shapes.size(), (int)tmp_model.batches.size());
+
 	shapes.clear();
 	materials.clear();
-	models.push_back(tmp_model);
+	models.push_back(move(tmp_model));
+	scene_dirty = true;
+}
+
+// Free the model's arena space and give back its texture array
+void UnloadModel(model& m)
+{
+	for (size_t i = 0; i < m.shapes.size(); i++)
+		FreeMesh(m.shapes[i].mesh);
+
+	if (m.textureArray != (TextureHandle)-1)
+		ReleaseTexture(m.textureArray);
+	m.materialBuffer.Reset();
+
+	m.shapes.clear();
+	m.batches.clear();
+	m.textureArray = -1;
+}
+
+// Load models[idx] again from disk, textures whose content did not change are reused
+void ReloadModel(int idx)
+{
+	// the new copy acquires its textures while the old one still holds them, so unchanged
+	// textures only gain a reference instead of being deleted and decoded again
+	LoadTexturedModels(model_list[idx]);
+	UnloadModel(models[idx]);
+	models[idx].shapes = models.back().shapes;
+	models[idx].textureArray = models.back().textureArray;
+	models[idx].materialBuffer = move(models.back().materialBuffer);
+	models[idx].materialCount = models.back().materialCount;
+	models[idx].batches = models.back().batches;
+	models[idx].sourceDraws = models.back().sourceDraws;
+	models[idx].vertexMask = models.back().vertexMask;
+	models[idx].textured = models.back().textured;
+	models.pop_back();
+
+	for (size_t j = 0; j < models[idx].shapes.size(); j++)
+		models[idx].shapes[j].material.shininess = 64;
+	models[idx].materialsDirty = true;
+
+	int texture_count, reference_count, pending_count, evicted_count, pool_count;
+	size_t resident_bytes, budget_bytes, mesh_bytes, arena_bytes;
+	GetTextureRegistryStats(texture_count, reference_count, pending_count);
+	GetTextureMemoryStats(resident_bytes, budget_bytes, evicted_count);
+	GetMeshArenaStats(pool_count, mesh_bytes, arena_bytes);
+	printf("Reload %s, %d textures with %d references, %.1f / %.1f MB resident, %d evicted, meshes %.1f / %.1f MB in %d pools\n", model_list[idx].c_str(),
+		texture_count, reference_count, resident_bytes / 1048576.0, budget_bytes / 1048576.0, evicted_count, mesh_bytes / 1048576.0, arena_bytes / 1048576.0, pool_count);
 }
 
 void initParameter()
@@ -1071,6 +1191,7 @@ void initParameter()
 	setViewingMatrix();
 	setPerspective();	//set default projection matrix as perspective matrix
 
+	lightInfo[0].type = LIGHT_DIRECTIONAL;
 	lightInfo[0].position[0] = 1.0f;
 	lightInfo[0].position[1] = 1.0f;
 	lightInfo[0].position[2] = 1.0f;
@@ -1084,6 +1205,7 @@ void initParameter()
 	lightInfo[0].specular[1] = 1.0f;
 	lightInfo[0].specular[2] = 1.0f;
 
+	lightInfo[1].type = LIGHT_POINT;
 	lightInfo[1].position[0] = 0.0f;
 	lightInfo[1].position[1] = 2.0f;
 	lightInfo[1].position[2] = 1.0f;
@@ -1101,6 +1223,7 @@ void initParameter()
 	lightInfo[1].linearAttenuation = 0.3f;
 	lightInfo[1].quadraticAttenuation = 0.6f;
 
+	lightInfo[2].type = LIGHT_SPOT;
 	lightInfo[2].position[0] = 0.0f;
 	lightInfo[2].position[1] = 0.0f;
 	lightInfo[2].position[2] = 2.0f;
@@ -1124,23 +1247,18 @@ void initParameter()
 	lightInfo[2].quadraticAttenuation = 0.6f;
 }
 
-GLuint iLocTex;
-void setUniformVariables()
-{
-	//iLocP = glGetUniformLocation(program, "um4p");
-	//iLocV = glGetUniformLocation(program, "um4v");
-	//iLocM = glGetUniformLocation(program, "um4m");
-
-	// [TODO] Get uniform location of texture
-	iLocTex = glGetUniformLocation(program, "tex");
-}
-
 void setupRC()
 {
 	// setup shaders
 	setShaders();
+	if (!InitRingBuffer(RING_REGION_BYTES))
+		cout << "setupRC: Out of memory for the ring buffer" << endl;
+	InitUniformBlocks();
+	if (indirect_draws)
+		InitDrawIndirect();
+	if (!InitMipFeedback())
+		cout << "setupRC: Mip streaming runs without coverage feedback" << endl;
 	initParameter();
-	setUniformVariables();
 
 	// OpenGL States and Values
 	glClearColor(0.2, 0.2, 0.2, 1.0);
@@ -1154,27 +1272,187 @@ void setupRC()
 			models[i].shapes[j].material.shininess = 64;
 }
 
-void glPrintContextInfo(bool printExtension)
+// Draw every model frames times in one vertex layout and report draw throughput.
+// Models are rebuilt in the layout first; GPU time comes from a timer query per frame
+void MeasureDrawThroughput(VertexLayout layout, int frames)
+{
+	vertex_layout = layout;
+	for (size_t i = 0; i < models.size(); i++)
+		ReloadModel((int)i);
+
+	int draws_per_frame = 0;
+	long long vertices_per_frame = 0;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		draws_per_frame += (int)models[i].batches.size();
+		for (size_t j = 0; j < models[i].shapes.size(); j++)
+			vertices_per_frame += models[i].shapes[j].mesh.indexCount;
+	}
+
+	GLQuery query;
+	query.Create();
+	glViewport(0, 0, screenWidth / 2, screenHeight);
+	if (light_dirty)
+		updateLight();
+
+	int saved_idx = cur_idx;
+	double gpu_ms = 0.0;
+	chrono::high_resolution_clock::time_point start;
+	// the first frames only warm up the driver
+	int warmup = min(8, frames);
+	for (int f = -warmup; f < frames; f++)
+	{
+		if (f == 0)
+		{
+			glFinish();
+			start = chrono::high_resolution_clock::now();
+		}
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		for (cur_idx = 0; cur_idx < (int)models.size(); cur_idx++)
+			RenderScene(SHADING_PER_VERTEX);
+		glEndQuery(GL_TIME_ELAPSED);
+		EndRingFrame();
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		if (f >= 0)
+			gpu_ms += elapsed / 1e6;
+	}
+	glFinish();
+	double wall_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	cur_idx = saved_idx;
+
+	double seconds = max(wall_ms, 1e-3) / 1000.0;
+	printf("%-12s %8.3f ms/frame %8.3f gpu ms/frame %10.0f draws/s %10.2f Mverts/s\n", layout == LAYOUT_INTERLEAVED ? "interleaved" : "split",
+		wall_ms / max(frames, 1), gpu_ms / max(frames, 1), (double)draws_per_frame * frames / seconds, (double)vertices_per_frame * frames / seconds / 1e6);
+}
+
+// Draw the current model as grids of 1, 4, 16, ... up to max_instances copies, frames times each,
+// and report how instance and triangle throughput scale
+void RunInstanceBenchmark(int max_instances, int frames)
 {
-	cout << "GL_VENDOR = " << (const char*)glGetString(GL_VENDOR) << endl;
-	cout << "GL_RENDERER = " << (const char*)glGetString(GL_RENDERER) << endl;
-	cout << "GL_VERSION = " << (const char*)glGetString(GL_VERSION) << endl;
-	cout << "GL_SHADING_LANGUAGE_VERSION = " << (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION) << endl;
-	if (printExtension)
+	long long triangles = CountTriangles(models[cur_idx]);
+	printf("Instance benchmark: %s, %lld triangles per copy, %d frames per grid\n", model_list[cur_idx].c_str(), triangles, frames);
+
+	GLQuery query;
+	query.Create();
+	glViewport(0, 0, screenWidth / 2, screenHeight);
+	if (light_dirty)
+		updateLight();
+
+	for (int count = 1; count <= max_instances; count = count < max_instances && count * 4 > max_instances ? max_instances : count * 4)
 	{
-		GLint numExt;
-		glGetIntegerv(GL_NUM_EXTENSIONS, &numExt);
-		cout << "GL_EXTENSIONS =" << endl;
-		for (GLint i = 0; i < numExt; i++)
+		if (!SetInstanceGrid(count))
+			break;
+
+		double gpu_ms = 0.0;
+		chrono::high_resolution_clock::time_point start;
+		int warmup = min(4, frames);
+		for (int f = -warmup; f < frames; f++)
 		{
-			cout << "\t" << (const char*)glGetStringi(GL_EXTENSIONS, i) << endl;
+			if (f == 0)
+			{
+				glFinish();
+				start = chrono::high_resolution_clock::now();
+			}
+
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			RenderScene(SHADING_PER_VERTEX);
+			glEndQuery(GL_TIME_ELAPSED);
+			EndRingFrame();
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+			if (f >= 0)
+				gpu_ms += elapsed / 1e6;
 		}
+		glFinish();
+		double wall_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+		double seconds = max(wall_ms, 1e-3) / 1000.0;
+		printf("%8d copies %8.3f ms/frame %8.3f gpu ms/frame %12.0f instances/s %10.2f Mtris/s\n", count,
+			wall_ms / max(frames, 1), gpu_ms / max(frames, 1), (double)count * frames / seconds, (double)count * triangles * frames / seconds / 1e6);
+		if (count == max_instances)
+			break;
 	}
+	SetInstanceGrid(0);
 }
 
+// Compare the split and interleaved layouts over all models
+void RunDrawBenchmark(int frames)
+{
+	int draws_per_frame = 0, source_draws = 0;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		draws_per_frame += (int)models[i].batches.size();
+		source_draws += models[i].sourceDraws;
+	}
+	printf("Draw benchmark: %d models, %d draws per frame (%d unbatched), %d frames\n", (int)models.size(), draws_per_frame, source_draws, frames);
+
+	MeasureDrawThroughput(LAYOUT_SPLIT, frames);
+	MeasureDrawThroughput(LAYOUT_INTERLEAVED, frames);
+}
 
 int main(int argc, char **argv)
 {
+	// offline normal map baking: --bake <low.obj> <high.obj> <out.bmp> [size]
+	if (argc >= 5 && string(argv[1]) == "--bake")
+	{
+		BakeSetting setting;
+		if (argc >= 6)
+			setting.width = setting.height = atoi(argv[5]);
+		return BakeNormalMap(argv[2], argv[3], argv[4], setting) ? 0 : 1;
+	}
+
+	// texture memory budget in MB: --texture-budget <MB>
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (string(argv[i]) == "--texture-budget")
+			SetTextureMemoryBudget((size_t)atoi(argv[i + 1]) * 1024 * 1024);
+	}
+	// redraw every frame as before instead of waiting for changes: --continuous
+	// draw the two views one after the other instead of in one instanced pass: --two-pass
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "--continuous")
+			event_driven = false;
+		else if (string(argv[i]) == "--two-pass")
+			single_pass_views = false;
+		else if (string(argv[i]) == "--no-merge")
+			merge_shapes = false;
+		else if (string(argv[i]) == "--no-indirect")
+			indirect_draws = false;
+		else if (string(argv[i]) == "--instances" && i + 1 < argc)
+			stress_instances = atoi(argv[++i]);
+	}
+
+	// texture pipeline benchmark: --bench-textures [dir] [--repeat N] [--no-compress] [--json out.json]
+	bool bench = argc >= 2 && string(argv[1]) == "--bench-textures";
+	BenchSetting bench_setting;
+	for (int i = 2; bench && i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--repeat" && i + 1 < argc)
+			bench_setting.repeat = max(1, atoi(argv[++i]));
+		else if (arg == "--json" && i + 1 < argc)
+			bench_setting.jsonPath = argv[++i];
+		else if (arg == "--no-compress")
+			bench_setting.compress = false;
+		else
+			bench_setting.directory = arg;
+	}
+
+	// vertex layout draw throughput: --bench-draw [frames]
+	bool bench_draw = argc >= 2 && string(argv[1]) == "--bench-draw";
+	int bench_frames = bench_draw && argc >= 3 ? max(1, atoi(argv[2])) : 200;
+
+	// instanced stress grid throughput: --bench-instances [max copies] [frames]
+	bool bench_instances = argc >= 2 && string(argv[1]) == "--bench-instances";
+	int bench_max_instances = bench_instances && argc >= 3 ? max(1, atoi(argv[2])) : 262144;
+	int bench_instance_frames = bench_instances && argc >= 4 ? max(1, atoi(argv[3])) : 100;
 
     // initial glfw
     glfwInit();
@@ -1185,6 +1463,9 @@ int main(int argc, char **argv)
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // fix compilation on OS X
 #endif
+	// the benchmarks never present a frame
+	if (bench || bench_draw || bench_instances)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
     
     // create window
@@ -1206,6 +1487,15 @@ int main(int argc, char **argv)
     }
 
 	glPrintContextInfo(false);
+
+	if (bench)
+	{
+		bool ok = RunTextureBenchmark(bench_setting);
+		ShutdownTextureStreaming();
+		ShutdownGLObjects();
+		glfwTerminate();
+		return ok ? 0 : 1;
+	}
     
 	// register glfw callback functions
     glfwSetKeyCallback(window, KeyCallback);
@@ -1214,170 +1504,184 @@ int main(int argc, char **argv)
 	glfwSetCursorPosCallback(window, cursor_pos_callback);
 
     glfwSetFramebufferSizeCallback(window, ChangeSize);
+	glfwSetWindowRefreshCallback(window, window_refresh_callback);
+	// a finished decode wakes the loop below when it sleeps in glfwWaitEvents
+	SetTextureDecodeNotify(glfwPostEmptyEvent);
 	glEnable(GL_DEPTH_TEST);
 	// Setup render context
 	setupRC();
 
-	// main loop
+	if (bench_draw)
+	{
+		RunDrawBenchmark(bench_frames);
+		ShutdownTextureStreaming();
+		ShutdownGLObjects();
+		glfwTerminate();
+		return 0;
+	}
+	if (bench_instances)
+	{
+		RunInstanceBenchmark(bench_max_instances, bench_instance_frames);
+		ShutdownTextureStreaming();
+		ShutdownGLObjects();
+		glfwTerminate();
+		return 0;
+	}
+	SetInstanceGrid(stress_instances);
+
+	// main loop; when event driven, a frame is only drawn after input, a model load or a streaming
+	// step changed the picture, otherwise the loop sleeps in glfwWaitEvents
     while (!glfwWindowShouldClose(window))
     {
-        // render
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-		// render left view
-		glViewport(0, 0, screenWidth / 2, screenHeight);
-		glUniform1i(vertex_or_perpixel, 0);
-        RenderScene(1);
-		// render right view
-		glViewport(screenWidth / 2, 0, screenWidth / 2, screenHeight);
-		glUniform1i(vertex_or_perpixel, 1);
-		RenderScene(0);
-        
-        // swap buffer from back to front
-        glfwSwapBuffers(window);
+		// streaming keeps drawing frames until its uploads and feedback readbacks settle
+		bool streaming = IsTextureStreamingBusy() || IsMipFeedbackPending();
+		if (scene_dirty || streaming || !event_driven)
+		{
+			bool changed = scene_dirty;
+			// the changed view may need other mip levels than the last pass saw
+			if (scene_dirty && event_driven)
+				RequestMipFeedback();
+			scene_dirty = false;
+			frames_drawn++;
+
+			// pick up textures decoded in the background, and the mip levels the last feedback pass asked for
+			UpdateMipFeedback();
+			if (UpdateTextureStreaming())
+				changed = true;
+			// waiting on a readback or on uploads still in flight redraws the same picture
+			if (!changed)
+				idle_frames++;
+
+			RenderMipFeedback();
+			// texture handler
+			textureParameterHandler();
+			// one light block update per frame, only when something changed
+			if (light_dirty)
+				updateLight();
+
+			// render
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+			if (single_pass_views)
+			{
+				// both views in one pass, the vertex shader places each instance in its half
+				glViewport(0, 0, screenWidth, screenHeight);
+				glEnable(GL_CLIP_DISTANCE0);
+				glEnable(GL_CLIP_DISTANCE1);
+				RenderScene(SHADING_DUAL_VIEW, 2);
+				glDisable(GL_CLIP_DISTANCE0);
+				glDisable(GL_CLIP_DISTANCE1);
+			}
+			else
+			{
+				// render left view
+				glViewport(0, 0, screenWidth / 2, screenHeight);
+				RenderScene(SHADING_PER_VERTEX);
+				// render right view
+				glViewport(screenWidth / 2, 0, screenWidth / 2, screenHeight);
+				RenderScene(SHADING_PER_PIXEL);
+			}
         
-        // Poll input event
-        glfwPollEvents();
+			// swap buffer from back to front
+			glfwSwapBuffers(window);
+			EndGLStateFrame();
+			EndRingFrame();
+		}
+
+		// Poll input event, or wait for one when nothing is left to draw
+		if (event_driven && !scene_dirty && !IsTextureStreamingBusy() && !IsMipFeedbackPending())
+		{
+			glfwWaitEvents();
+			event_waits++;
+		}
+		else
+			glfwPollEvents();
     }
-	
+
+	for (size_t i = 0; i < models.size(); i++)
+		UnloadModel(models[i]);
+	ShutdownTextureStreaming();
+	DeleteSamplers();
+	DeleteMipFeedback();
+	DeleteMeshArena();
+	DeleteUniformBlocks();
+	DeleteInstanceGrid();
+	DeleteDrawIndirect();
+	DeleteRingBuffer();
+	DeleteShaderVariants();
+	ShutdownGLObjects();
+	printf("Frames drawn %d, idle frames %d, event waits %d\n", frames_drawn, idle_frames, event_waits);
+
 	// just for compatibiliy purposes
 	return 0;
 }
 
-void set_variables(GLuint p)
-{
-	vertex_or_perpixel = glGetUniformLocation(p, "vertex_or_perpixel");
-
-	iLocMVP = glGetUniformLocation(p, "mvp");
-	iLocV = glGetUniformLocation(p, "view_matrix");
-	iLocM = glGetUniformLocation(p, "model_matrix");
-	iLocLightType = glGetUniformLocation(p, "light_type");
-	iLocKa = glGetUniformLocation(p, "material.Ka");
-	iLocKd = glGetUniformLocation(p, "material.Kd");
-	iLocKs = glGetUniformLocation(p, "material.Ks");
-	iLocShininess = glGetUniformLocation(p, "material.shininess");
-
-	iLocLightInfo[0].position = glGetUniformLocation(p, "light[0].position");
-	iLocLightInfo[0].ambient = glGetUniformLocation(p, "light[0].Ambient");
-	iLocLightInfo[0].diffuse = glGetUniformLocation(p, "light[0].Diffuse");
-	iLocLightInfo[0].specular = glGetUniformLocation(p, "light[0].Specular");
-	iLocLightInfo[0].spotDirection = glGetUniformLocation(p, "light[0].spotDirection");
-	iLocLightInfo[0].spotCutoff = glGetUniformLocation(p, "light[0].spotCutoff");
-	iLocLightInfo[0].spotExponent = glGetUniformLocation(p, "light[0].spotExponent");
-	iLocLightInfo[0].constantAttenuation = glGetUniformLocation(p, "light[0].constantAttenuation");
-	iLocLightInfo[0].linearAttenuation = glGetUniformLocation(p, "light[0].linearAttenuation");
-	iLocLightInfo[0].quadraticAttenuation = glGetUniformLocation(p, "light[0].quadraticAttenuation");
-
-	iLocLightInfo[1].position = glGetUniformLocation(p, "light[1].position");
-	iLocLightInfo[1].ambient = glGetUniformLocation(p, "light[1].Ambient");
-	iLocLightInfo[1].diffuse = glGetUniformLocation(p, "light[1].Diffuse");
-	iLocLightInfo[1].specular = glGetUniformLocation(p, "light[1].Specular");
-	iLocLightInfo[1].spotDirection = glGetUniformLocation(p, "light[1].spotDirection");
-	iLocLightInfo[1].spotCutoff = glGetUniformLocation(p, "light[1].spotCutoff");
-	iLocLightInfo[1].spotExponent = glGetUniformLocation(p, "light[1].spotExponent");
-	iLocLightInfo[1].constantAttenuation = glGetUniformLocation(p, "light[1].constantAttenuation");
-	iLocLightInfo[1].linearAttenuation = glGetUniformLocation(p, "light[1].linearAttenuation");
-	iLocLightInfo[1].quadraticAttenuation = glGetUniformLocation(p, "light[1].quadraticAttenuation");
-
-	iLocLightInfo[2].position = glGetUniformLocation(p, "light[2].position");
-	iLocLightInfo[2].ambient = glGetUniformLocation(p, "light[2].Ambient");
-	iLocLightInfo[2].diffuse = glGetUniformLocation(p, "light[2].Diffuse");
-	iLocLightInfo[2].specular = glGetUniformLocation(p, "light[2].Specular");
-	iLocLightInfo[2].spotDirection = glGetUniformLocation(p, "light[2].spotDirection");
-	iLocLightInfo[2].spotCutoff = glGetUniformLocation(p, "light[2].spotCutoff");
-	iLocLightInfo[2].spotExponent = glGetUniformLocation(p, "light[2].spotExponent");
-	iLocLightInfo[2].constantAttenuation = glGetUniformLocation(p, "light[2].constantAttenuation");
-	iLocLightInfo[2].linearAttenuation = glGetUniformLocation(p, "light[2].linearAttenuation");
-	iLocLightInfo[2].quadraticAttenuation = glGetUniformLocation(p, "light[2].quadraticAttenuation");
-}
-
+// Copy the lights into the light block with the A/D/N toggles applied, moved into view space once
+// here so the shaders do not transform them for every vertex and fragment
 void updateLight()
 {
-	if (ambient_flag)
+	vector<LightStd140> lights(lightInfo.size());
+	for (size_t i = 0; i < lightInfo.size(); i++)
 	{
-		glUniform3f(iLocLightInfo[0].ambient, lightInfo[0].ambient[0], lightInfo[0].ambient[1], lightInfo[0].ambient[2]);
-		glUniform3f(iLocLightInfo[1].ambient, lightInfo[1].ambient[0], lightInfo[1].ambient[1], lightInfo[1].ambient[2]);
-		glUniform3f(iLocLightInfo[2].ambient, lightInfo[2].ambient[0], lightInfo[2].ambient[1], lightInfo[2].ambient[2]);
-	}
-	else
-	{
-		float zeros[] = { 0.0f, 0.0f, 0.0f };
-		glUniform3fv(iLocLightInfo[0].ambient, 1, zeros);
-		glUniform3fv(iLocLightInfo[1].ambient, 1, zeros);
-		glUniform3fv(iLocLightInfo[2].ambient, 1, zeros);
+		LightStd140& light = lights[i];
+		memset(&light, 0, sizeof(light));
+		const float* p = lightInfo[i].position;
+		const float* d = lightInfo[i].spotDirection;
+		Vector4 position = view_matrix * Vector4(p[0], p[1], p[2], 1.0f);
+		// only spot lights have a direction, the others leave it zero; normalize has no zero guard
+		Vector3 direction = view_matrix * Vector3(d[0], d[1], d[2]);
+		if (direction.length() > 0.0f)
+			direction.normalize();
+		light.position[0] = position.x;
+		light.position[1] = position.y;
+		light.position[2] = position.z;
+		light.spotDirection[0] = direction.x;
+		light.spotDirection[1] = direction.y;
+		light.spotDirection[2] = direction.z;
+		for (int c = 0; c < 3; c++)
+		{
+			light.ambient[c] = ambient_flag ? lightInfo[i].ambient[c] : 0.0f;
+			light.diffuse[c] = diffuse_flag ? lightInfo[i].diffuse[c] : 0.0f;
+			light.specular[c] = specular_flag ? lightInfo[i].specular[c] : 0.0f;
+		}
+		light.type = lightInfo[i].type;
+		light.spotExponent = lightInfo[i].spotExponent;
+		light.spotCutoff = lightInfo[i].spotCutoff;
+		light.constantAttenuation = lightInfo[i].constantAttenuation;
+		light.linearAttenuation = lightInfo[i].linearAttenuation;
+		light.quadraticAttenuation = lightInfo[i].quadraticAttenuation;
 	}
 
-	if (diffuse_flag)
-	{
-		glUniform3f(iLocLightInfo[0].diffuse, lightInfo[0].diffuse[0], lightInfo[0].diffuse[1], lightInfo[0].diffuse[2]);
-		glUniform3f(iLocLightInfo[1].diffuse, lightInfo[1].diffuse[0], lightInfo[1].diffuse[1], lightInfo[1].diffuse[2]);
-		glUniform3f(iLocLightInfo[2].diffuse, lightInfo[2].diffuse[0], lightInfo[2].diffuse[1], lightInfo[2].diffuse[2]);
-	}
-	else
-	{
-		float zeros[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-		glUniform3fv(iLocLightInfo[0].diffuse, 1, zeros);
-		glUniform3fv(iLocLightInfo[1].diffuse, 1, zeros);
-		glUniform3fv(iLocLightInfo[2].diffuse, 1, zeros);
-	}
+	UpdateLightBlock(lights.empty() ? NULL : &lights[0], (int)lights.size());
+	light_dirty = false;
+}
 
-	if (specular_flag)
-	{
-		glUniform3f(iLocLightInfo[0].specular, lightInfo[0].specular[0], lightInfo[0].specular[1], lightInfo[0].specular[2]);
-		glUniform3f(iLocLightInfo[1].specular, lightInfo[1].specular[0], lightInfo[1].specular[1], lightInfo[1].specular[2]);
-		glUniform3f(iLocLightInfo[2].specular, lightInfo[2].specular[0], lightInfo[2].specular[1], lightInfo[2].specular[2]);
-	}
-	else
+// Copy the model's shape materials into its material buffer
+void updateModelMaterials(model& m)
+{
+	vector<MaterialStd140> materials(m.materialCount);
+	if (!materials.empty())
+		memset(&materials[0], 0, materials.size() * sizeof(MaterialStd140));
+	for (size_t i = 0; i < m.shapes.size(); i++)
 	{
-		float zeros[] = { 0.0f, 0.0f, 0.0f, 0.0f };
-		glUniform3fv(iLocLightInfo[0].specular, 1, zeros);
-		glUniform3fv(iLocLightInfo[1].specular, 1, zeros);
-		glUniform3fv(iLocLightInfo[2].specular, 1, zeros);
+		const PhongMaterial& src = m.shapes[i].material;
+		MaterialStd140& dst = materials[m.shapes[i].materialIndex];
+		for (int c = 0; c < 3; c++)
+		{
+			dst.Ka[c] = src.Ka[c];
+			dst.Kd[c] = src.Kd[c];
+			dst.Ks[c] = src.Ks[c];
+		}
+		dst.shininess = src.shininess;
+		dst.diffuseLayer = src.diffuseLayer;
 	}
 
-	glUniform3f(iLocLightInfo[0].position, lightInfo[0].position[0], lightInfo[0].position[1], lightInfo[0].position[2]);
-
-	glUniform3f(iLocLightInfo[1].position, lightInfo[1].position[0], lightInfo[1].position[1], lightInfo[1].position[2]);
-	glUniform1f(iLocLightInfo[1].constantAttenuation, lightInfo[1].constantAttenuation);
-	glUniform1f(iLocLightInfo[1].linearAttenuation, lightInfo[1].linearAttenuation);
-	glUniform1f(iLocLightInfo[1].quadraticAttenuation, lightInfo[1].quadraticAttenuation);
-
-	glUniform3f(iLocLightInfo[2].position, lightInfo[2].position[0], lightInfo[2].position[1], lightInfo[2].position[2]);
-	glUniform3f(iLocLightInfo[2].spotDirection, lightInfo[2].spotDirection[0], lightInfo[2].spotDirection[1], lightInfo[2].spotDirection[2]);
-	glUniform1f(iLocLightInfo[2].spotExponent, lightInfo[2].spotExponent);
-	glUniform1f(iLocLightInfo[2].spotCutoff, lightInfo[2].spotCutoff);
-	glUniform1f(iLocLightInfo[2].constantAttenuation, lightInfo[2].constantAttenuation);
-	glUniform1f(iLocLightInfo[2].linearAttenuation, lightInfo[2].linearAttenuation);
-	glUniform1f(iLocLightInfo[2].quadraticAttenuation, lightInfo[2].quadraticAttenuation);
+	if (!materials.empty())
+		UpdateMaterialBuffer(m.materialBuffer, &materials[0], (int)materials.size());
+	m.materialsDirty = false;
 }
 
+// Bind the sampler for the G/B/V toggles to texture unit 0, GL is only touched when they change
 void textureParameterHandler()
 {
-	if (mag_linear)
-	{
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	}
-	else
-	{
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	}
-
-	if (min_linear)
-	{
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	}
-	else
-	{
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	}
-
-	if (repeat)
-	{
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	}
-	else
-	{
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-	}
+	SetSampler(0, GetSampler(mag_linear, min_linear, repeat));
 }
\ No newline at end of file
@@ -0,0 +1,352 @@
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "mesharena.h"
+#include "glstate.h"
+#include "globject.h"
+
+using namespace std;
+
+namespace
+{
+	const int INITIAL_VERTICES = 1 << 16;
+	const int INITIAL_INDICES = 1 << 18;
+
+	// First fit allocator over [0, capacity), in vertices or indices
+	struct RangeAllocator
+	{
+		struct Block
+		{
+			int offset;
+			int count;
+		};
+		vector<Block> free;		// sorted by offset, adjacent blocks are merged
+		int capacity = 0;
+		int used = 0;
+	};
+
+	int Allocate(RangeAllocator& allocator, int count)
+	{
+		for (size_t i = 0; i < allocator.free.size(); i++)
+		{
+			RangeAllocator::Block& block = allocator.free[i];
+			if (block.count < count)
+				continue;
+
+			int offset = block.offset;
+			block.offset += count;
+			block.count -= count;
+			if (block.count == 0)
+				allocator.free.erase(allocator.free.begin() + i);
+			allocator.used += count;
+			return offset;
+		}
+		return -1;
+	}
+
+	void Free(RangeAllocator& allocator, int offset, int count)
+	{
+		if (count == 0)
+			return;
+
+		vector<RangeAllocator::Block>& free = allocator.free;
+		size_t i = 0;
+		while (i < free.size() && free[i].offset < offset)
+			i++;
+		free.insert(free.begin() + i, RangeAllocator::Block{ offset, count });
+		allocator.used -= count;
+
+		// merge with the following and the preceding block
+		if (i + 1 < free.size() && free[i].offset + free[i].count == free[i + 1].offset)
+		{
+			free[i].count += free[i + 1].count;
+			free.erase(free.begin() + i + 1);
+		}
+		if (i > 0 && free[i - 1].offset + free[i - 1].count == free[i].offset)
+		{
+			free[i - 1].count += free[i].count;
+			free.erase(free.begin() + i);
+		}
+	}
+
+	// Add [capacity, new_capacity) to the free space
+	void Grow(RangeAllocator& allocator, int new_capacity)
+	{
+		int added = new_capacity - allocator.capacity;
+		allocator.used += added;
+		Free(allocator, allocator.capacity, added);
+		allocator.capacity = new_capacity;
+	}
+
+	// Capacity whose new space alone fits count elements, doubling so growth stays rare
+	int GrownCapacity(const RangeAllocator& allocator, int count, int initial)
+	{
+		int capacity = allocator.capacity == 0 ? initial : allocator.capacity * 2;
+		while (capacity - allocator.capacity < count)
+			capacity *= 2;
+		return capacity;
+	}
+
+	struct MeshPool
+	{
+		VertexFormat format;
+		VertexLayout layout;
+		GLVertexArray vao;
+		GLBuffer buffers[ATTRIB_COUNT];	// the interleaved layout only uses buffers[0]
+		RangeAllocator vertices;
+	};
+
+	vector<MeshPool> pools;
+	GLBuffer indexBuffer;
+	RangeAllocator indices;
+
+	// Replace buffer with one of new_bytes keeping its first old_bytes. False when the GL is out of
+	// memory, buffer is left as it was
+	bool ResizeBuffer(GLBuffer& buffer, size_t old_bytes, size_t new_bytes)
+	{
+		GLOwnerScope owner("mesh arena");
+		GLBuffer resized;
+		resized.Create();
+		glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+		glBufferData(GL_COPY_WRITE_BUFFER, new_bytes, NULL, GL_STATIC_DRAW);
+		// a failed allocation leaves the store empty; asking its size leaves the error queue,
+		// and whatever other code left in it, alone
+		GLint64 size = 0;
+		glGetBufferParameteri64v(GL_COPY_WRITE_BUFFER, GL_BUFFER_SIZE, &size);
+		if ((size_t)size != new_bytes)
+			return false;
+		resized.SetBytes(new_bytes);
+		if (buffer != 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_bytes);
+		}
+		buffer = move(resized);
+		return true;
+	}
+
+	// Point the pool's vertex array at its current buffers
+	void SetPoolAttributes(const MeshPool& pool)
+	{
+		GLuint names[ATTRIB_COUNT];
+		for (int i = 0; i < ATTRIB_COUNT; i++)
+			names[i] = pool.buffers[i];
+		SetVertexArray(pool.vao);
+		SetVertexAttributes(pool.format, pool.layout, names);
+		SetVertexArray(0);
+	}
+
+	// Bytes per vertex a buffer of the pool holds
+	size_t BufferStride(const MeshPool& pool, int buffer)
+	{
+		if (pool.layout == LAYOUT_INTERLEAVED)
+			return buffer == 0 ? pool.format.stride : 0;
+		return pool.format.components[buffer] * sizeof(GLfloat);
+	}
+
+	// Offset of count free vertices in the pool, growing its buffers when no free block fits
+	int AllocateVertices(MeshPool& pool, int count)
+	{
+		int offset = Allocate(pool.vertices, count);
+		if (offset >= 0)
+			return offset;
+
+		int capacity = GrownCapacity(pool.vertices, count, INITIAL_VERTICES);
+		bool resized = true;
+		for (int i = 0; i < ATTRIB_COUNT && resized; i++)
+		{
+			size_t stride = BufferStride(pool, i);
+			if (stride != 0)
+				resized = ResizeBuffer(pool.buffers[i], pool.vertices.capacity * stride, capacity * stride);
+		}
+
+		// the vertex array still points at the old buffers; after a failure the ones already
+		// replaced are larger than needed but hold the same vertices
+		SetPoolAttributes(pool);
+		if (!resized)
+			return -1;
+		Grow(pool.vertices, capacity);
+		return Allocate(pool.vertices, count);
+	}
+
+	int AllocateIndices(int count)
+	{
+		int offset = Allocate(indices, count);
+		if (offset >= 0)
+			return offset;
+
+		int capacity = GrownCapacity(indices, count, INITIAL_INDICES);
+		if (!ResizeBuffer(indexBuffer, indices.capacity * sizeof(GLuint), capacity * sizeof(GLuint)))
+			return -1;
+		Grow(indices, capacity);
+
+		for (size_t i = 0; i < pools.size(); i++)
+		{
+			SetVertexArray(pools[i].vao);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		}
+		SetVertexArray(0);
+		return Allocate(indices, count);
+	}
+
+	int FindPool(const VertexFormat& format, VertexLayout layout)
+	{
+		for (size_t i = 0; i < pools.size(); i++)
+		{
+			if (pools[i].format.mask == format.mask && pools[i].layout == layout)
+				return (int)i;
+		}
+
+		GLOwnerScope owner("mesh arena");
+		MeshPool pool;
+		pool.format = format;
+		pool.layout = layout;
+		pool.vao.Create();
+		SetVertexArray(pool.vao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		SetVertexArray(0);
+		pools.push_back(move(pool));
+		return (int)pools.size() - 1;
+	}
+}
+
+bool AllocateMesh(const VertexFormat& format, VertexLayout layout, const GLfloat* vertices, int vertex_count, const GLuint* indices_data, int index_count, MeshRange& range)
+{
+	range = MeshRange();
+	if (vertex_count == 0 || index_count == 0)
+		return true;
+
+	int p = FindPool(format, layout);
+	MeshPool& pool = pools[p];
+	int base_vertex = AllocateVertices(pool, vertex_count);
+	int first_index = base_vertex < 0 ? -1 : AllocateIndices(index_count);
+	if (first_index < 0)
+	{
+		if (base_vertex >= 0)
+			Free(pool.vertices, base_vertex, vertex_count);
+		cout << "AllocateMesh: Out of memory for " << vertex_count << " vertices" << endl;
+		return false;
+	}
+
+	range.pool = p;
+	range.baseVertex = base_vertex;
+	range.vertexCount = vertex_count;
+	range.firstIndex = first_index;
+	range.indexCount = index_count;
+
+	if (layout == LAYOUT_INTERLEAVED)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, pool.buffers[0]);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)range.baseVertex * format.stride, (size_t)vertex_count * format.stride, vertices);
+	}
+	else
+	{
+		// pick each attribute out of the interleaved vertices
+		int floatsPerVertex = format.stride / (int)sizeof(GLfloat);
+		vector<GLfloat> attribute;
+		for (int i = 0; i < ATTRIB_COUNT; i++)
+		{
+			int components = format.components[i];
+			if (components == 0)
+				continue;
+
+			attribute.resize((size_t)vertex_count * components);
+			const GLfloat* src = vertices + format.offsets[i] / sizeof(GLfloat);
+			for (int v = 0; v < vertex_count; v++, src += floatsPerVertex)
+			{
+				for (int c = 0; c < components; c++)
+					attribute[(size_t)v * components + c] = src[c];
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER, pool.buffers[i]);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)range.baseVertex * components * sizeof(GLfloat), attribute.size() * sizeof(GLfloat), &attribute[0]);
+		}
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, (size_t)range.firstIndex * sizeof(GLuint), (size_t)index_count * sizeof(GLuint), indices_data);
+	return true;
+}
+
+void FreeMesh(MeshRange& range)
+{
+	if (range.pool >= 0 && range.pool < (int)pools.size())
+	{
+		Free(pools[range.pool].vertices, range.baseVertex, range.vertexCount);
+		Free(indices, range.firstIndex, range.indexCount);
+	}
+	range = MeshRange();
+}
+
+void BindMeshPool(int pool)
+{
+	if (pool >= 0 && pool < (int)pools.size())
+		SetVertexArray(pools[pool].vao);
+}
+
+void DrawMesh(const MeshRange& range)
+{
+	if (range.indexCount == 0)
+		return;
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (const void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+}
+
+void DrawMeshInstanced(const MeshRange& range, int instance_count)
+{
+	if (range.indexCount == 0)
+		return;
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (const void*)(range.firstIndex * sizeof(GLuint)), instance_count, range.baseVertex);
+}
+
+bool AddMeshToBatch(MeshBatch& batch, const MeshRange& range)
+{
+	if (range.indexCount == 0)
+		return true;
+	if (batch.pool != -1 && batch.pool != range.pool)
+		return false;
+
+	batch.pool = range.pool;
+	batch.counts.push_back(range.indexCount);
+	batch.indexOffsets.push_back((const void*)(range.firstIndex * sizeof(GLuint)));
+	batch.baseVertices.push_back(range.baseVertex);
+	return true;
+}
+
+void DrawMeshBatch(const MeshBatch& batch, int instance_count)
+{
+	GLsizei draw_count = (GLsizei)batch.counts.size();
+	if (draw_count == 0)
+		return;
+
+	if (instance_count > 1)
+	{
+		for (int i = 0; i < draw_count; i++)
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, batch.counts[i], GL_UNSIGNED_INT, batch.indexOffsets[i], instance_count, batch.baseVertices[i]);
+	}
+	else if (draw_count == 1)
+		glDrawElementsBaseVertex(GL_TRIANGLES, batch.counts[0], GL_UNSIGNED_INT, batch.indexOffsets[0], batch.baseVertices[0]);
+	else
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, &batch.counts[0], GL_UNSIGNED_INT, &batch.indexOffsets[0], draw_count, &batch.baseVertices[0]);
+}
+
+void DeleteMeshArena()
+{
+	SetVertexArray(0);
+	pools.clear();
+	indexBuffer.Reset();
+	indices = RangeAllocator();
+}
+
+void GetMeshArenaStats(int& pool_count, size_t& used_bytes, size_t& capacity_bytes)
+{
+	pool_count = (int)pools.size();
+	used_bytes = (size_t)indices.used * sizeof(GLuint);
+	capacity_bytes = (size_t)indices.capacity * sizeof(GLuint);
+	for (size_t i = 0; i < pools.size(); i++)
+	{
+		size_t vertex_bytes = 0;
+		for (int j = 0; j < ATTRIB_COUNT; j++)
+			vertex_bytes += BufferStride(pools[i], j);
+		used_bytes += (size_t)pools[i].vertices.used * vertex_bytes;
+		capacity_bytes += (size_t)pools[i].vertices.capacity * vertex_bytes;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <stddef.h>
+#include <vector>
+#include <glad/glad.h>
+#include "vertexformat.h"
+
+// Global geometry arena
+// All meshes share a few large buffers instead of owning their own: one vertex pool per vertex
+// format and layout (with one vertex array object each) and a single index buffer for everything.
+// Space is handed out first fit and the buffers double when full. A mesh is just a record of where
+// its vertices and indices live, drawn with glDrawElementsBaseVertex, so drawing a model only binds
+// one vertex array and loading many small meshes no longer creates GL objects per mesh.
+
+struct MeshRange
+{
+	int pool = -1;			// vertex pool holding the vertices, -1 when empty
+	int baseVertex = 0;		// first vertex inside the pool
+	int vertexCount = 0;
+	int firstIndex = 0;		// first index inside the shared index buffer
+	int indexCount = 0;		// indices are relative to baseVertex
+};
+
+// Copy interleaved vertices and their indices into the arena, false if GL runs out of memory
+bool AllocateMesh(const VertexFormat& format, VertexLayout layout, const GLfloat* vertices, int vertex_count, const GLuint* indices, int index_count, MeshRange& range);
+// Give the space back, range becomes empty
+void FreeMesh(MeshRange& range);
+
+// Bind the vertex array of a pool; every mesh in it can then be drawn without rebinding
+void BindMeshPool(int pool);
+void DrawMesh(const MeshRange& range);
+void DrawMeshInstanced(const MeshRange& range, int instance_count);
+
+// Meshes of one pool drawn with the same state, issued as a single glMultiDrawElementsBaseVertex
+struct MeshBatch
+{
+	int pool = -1;
+	std::vector<GLsizei> counts;
+	std::vector<const void*> indexOffsets;	// byte offsets into the shared index buffer
+	std::vector<GLint> baseVertices;
+};
+
+// Append a mesh to the batch, false if it lives in another pool than the meshes already in it
+bool AddMeshToBatch(MeshBatch& batch, const MeshRange& range);
+// Draw every mesh of the batch, its pool has to be bound. There is no instanced multi-draw
+// before GL 4.3, so instance_count > 1 issues one instanced draw per mesh
+void DrawMeshBatch(const MeshBatch& batch, int instance_count = 1);
+
+void DeleteMeshArena();
+
+// Pools in use and the bytes meshes occupy against the bytes the buffers hold
+void GetMeshArenaStats(int& pool_count, size_t& used_bytes, size_t& capacity_bytes);
+
+#endif
@@ -0,0 +1,238 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include "mipfeedback.h"
+#include "textfile.h"
+#include "globject.h"
+#include "glstate.h"
+
+using namespace std;
+
+namespace
+{
+	const int FEEDBACK_SCALE = 8;		// feedback pixels are FEEDBACK_SCALE x FEEDBACK_SCALE screen pixels
+	const int FEEDBACK_INTERVAL = 8;	// frames between two passes
+	const float LOD_STEPS = 16.0f;		// fixed point steps per mip level in the target
+
+	GLProgram program;
+	GLint iLocMVP;
+	GLint iLocTextureId;
+	GLint iLocTextureSize;
+	GLint iLocLodBias;
+
+	GLFramebuffer fbo;
+	GLRenderbuffer colorBuffer;
+	GLRenderbuffer depthBuffer;
+	int targetWidth = 0;
+	int targetHeight = 0;
+
+	GLBuffer readbackPBO;
+	GLsync readbackFence = 0;
+	int readbackWidth = 0;
+	int readbackHeight = 0;
+	int frameCount = 0;
+	bool passRequested = false;
+
+	GLShader CompileShader(GLenum type, const char* path)
+	{
+		GLShader shader;
+		char* source = textFileRead(path);
+		if (source == NULL)
+		{
+			cout << "InitMipFeedback: Cannot read " << path << endl;
+			return shader;
+		}
+
+		shader.Create(type);
+		glShaderSource(shader, 1, (const GLchar**)&source, NULL);
+		free(source);
+		glCompileShader(shader);
+
+		GLint success;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			char infoLog[1000];
+			glGetShaderInfoLog(shader, 1000, NULL, infoLog);
+			cout << "InitMipFeedback: " << path << " failed to compile\n" << infoLog << endl;
+			shader.Reset();
+		}
+		return shader;
+	}
+
+	void DeleteTarget()
+	{
+		fbo.Reset();
+		colorBuffer.Reset();
+		depthBuffer.Reset();
+		targetWidth = targetHeight = 0;
+	}
+
+	void CreateTarget(int width, int height)
+	{
+		DeleteTarget();
+		GLOwnerScope owner("mip feedback");
+		colorBuffer.Create();
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RG32UI, width, height);
+		colorBuffer.SetBytes((size_t)width * height * 2 * sizeof(GLuint));
+		depthBuffer.Create();
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		depthBuffer.SetBytes((size_t)width * height * 4);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		fbo.Create();
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			cout << "BeginMipFeedback: Feedback framebuffer is incomplete" << endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		targetWidth = width;
+		targetHeight = height;
+	}
+}
+
+bool InitMipFeedback()
+{
+	GLOwnerScope owner("mip feedback");
+	GLShader v = CompileShader(GL_VERTEX_SHADER, "feedback.vs.glsl");
+	GLShader f = CompileShader(GL_FRAGMENT_SHADER, "feedback.fs.glsl");
+	if (v == 0 || f == 0)
+		return false;
+
+	program.Create();
+	glAttachShader(program, v);
+	glAttachShader(program, f);
+	glLinkProgram(program);
+	v.Reset();
+	f.Reset();
+
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		char infoLog[1000];
+		glGetProgramInfoLog(program, 1000, NULL, infoLog);
+		cout << "InitMipFeedback: Feedback program failed to link\n" << infoLog << endl;
+		program.Reset();
+		return false;
+	}
+
+	iLocMVP = glGetUniformLocation(program, "mvp");
+	iLocTextureId = glGetUniformLocation(program, "textureId");
+	iLocTextureSize = glGetUniformLocation(program, "textureSize0");
+	iLocLodBias = glGetUniformLocation(program, "lodBias");
+	readbackPBO.Create();
+	return true;
+}
+
+void DeleteMipFeedback()
+{
+	DeleteTarget();
+	if (readbackFence != 0)
+		glDeleteSync(readbackFence);
+	readbackPBO.Reset();
+	program.Reset();
+	readbackFence = 0;
+}
+
+bool BeginMipFeedback(int view_width, int view_height)
+{
+	if (program == 0 || readbackFence != 0 || (!passRequested && frameCount % FEEDBACK_INTERVAL != 0))
+		return false;
+	passRequested = false;
+
+	int width = max(1, view_width / FEEDBACK_SCALE), height = max(1, view_height / FEEDBACK_SCALE);
+	if (width != targetWidth || height != targetHeight)
+		CreateTarget(width, height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, targetWidth, targetHeight);
+	// 0 marks pixels without a texture, so texture ids are stored as handle + 1
+	const GLuint clearColor[] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, clearColor);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	SetProgram(program);
+	// the target is FEEDBACK_SCALE times coarser than the screen, so its derivatives are too
+	glUniform1f(iLocLodBias, log2f((float)view_width / targetWidth));
+	return true;
+}
+
+void SetMipFeedbackTexture(TextureHandle handle, const GLfloat* mvp)
+{
+	int width = 1, height = 1;
+	GetTextureSize(handle, width, height);
+	glUniformMatrix4fv(iLocMVP, 1, GL_FALSE, mvp);
+	glUniform1ui(iLocTextureId, handle + 1);
+	glUniform2f(iLocTextureSize, (float)width, (float)height);
+}
+
+void EndMipFeedback()
+{
+	size_t size = (size_t)targetWidth * targetHeight * 2 * sizeof(GLuint);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBO);
+	glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	readbackPBO.SetBytes(size);
+	glReadPixels(0, 0, targetWidth, targetHeight, GL_RG_INTEGER, GL_UNSIGNED_INT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readbackWidth = targetWidth;
+	readbackHeight = targetHeight;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RequestMipFeedback()
+{
+	passRequested = true;
+}
+
+bool IsMipFeedbackPending()
+{
+	return program != 0 && (passRequested || readbackFence != 0);
+}
+
+void UpdateMipFeedback()
+{
+	frameCount++;
+	if (readbackFence == 0)
+		return;
+
+	GLenum status = glClientWaitSync(readbackFence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return;
+	glDeleteSync(readbackFence);
+	readbackFence = 0;
+
+	size_t count = (size_t)readbackWidth * readbackHeight;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPBO);
+	const GLuint* texels = (const GLuint*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 2 * sizeof(GLuint), GL_MAP_READ_BIT);
+	if (texels != NULL)
+	{
+		// finest level per texture over the whole view
+		map<GLuint, GLuint> finest;
+		for (size_t i = 0; i < count; i++)
+		{
+			GLuint id = texels[i * 2], lod = texels[i * 2 + 1];
+			if (id == 0)
+				continue;
+			map<GLuint, GLuint>::iterator it = finest.find(id);
+			if (it == finest.end())
+				finest[id] = lod;
+			else if (lod < it->second)
+				it->second = lod;
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+		for (map<GLuint, GLuint>::iterator it = finest.begin(); it != finest.end(); ++it)
+			SetTextureWantedLevel(it->first - 1, (int)floor(it->second / LOD_STEPS));
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
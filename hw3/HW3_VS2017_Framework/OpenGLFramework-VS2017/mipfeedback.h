@@ -0,0 +1,33 @@
+#ifndef MIP_FEEDBACK_H
+#define MIP_FEEDBACK_H
+
+#include <glad/glad.h>
+#include "texture.h"
+
+// Screen coverage feedback for mip streaming
+// Every few frames the visible geometry is drawn again into a small integer target, each pixel
+// storing the texture it shows and the mip level the sampler would pick there (feedback.fs.glsl).
+// The target is read back through a pixel buffer a frame later, so the pass never stalls, and the
+// finest level per texture goes to SetTextureWantedLevel.
+
+// Compile the feedback shaders, false if they fail
+bool InitMipFeedback();
+void DeleteMipFeedback();
+
+// Bind the feedback target and program for a view_width x view_height view.
+// False on the frames that skip the pass or while a readback is still in flight
+bool BeginMipFeedback(int view_width, int view_height);
+// Texture and transform of the geometry drawn next
+void SetMipFeedbackTexture(TextureHandle handle, const GLfloat* mvp);
+// Start the readback and restore the default framebuffer; the caller rebinds its own program and viewport
+void EndMipFeedback();
+
+// Called once per frame: forwards a finished readback to the texture registry
+void UpdateMipFeedback();
+
+// Run the pass on the next frame that can take it instead of waiting for the interval, after the view changed
+void RequestMipFeedback();
+// True while a requested pass or its readback has not finished
+bool IsMipFeedbackPending();
+
+#endif
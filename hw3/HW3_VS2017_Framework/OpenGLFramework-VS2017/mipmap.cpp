@@ -0,0 +1,220 @@
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <math.h>
+#include "mipmap.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define MIP_USE_SSE
+#endif
+
+using namespace std;
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+	const float KAISER_WIDTH = 3.0f;	// kernel radius in destination texels
+	const float KAISER_ALPHA = 4.0f;
+	const int LINEAR_TO_SRGB_STEPS = 4096;
+
+	// Source taps of one destination texel along one axis
+	struct FilterTap
+	{
+		vector<int> index;
+		vector<float> weight;
+	};
+
+	float BesselI0(float x)
+	{
+		float sum = 1.0f, term = 1.0f, half = x * 0.5f;
+		for (int k = 1; k < 32 && term > sum * 1e-8f; k++)
+		{
+			term *= (half / k) * (half / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	float KaiserSinc(float t)
+	{
+		float sinc = fabs(t) < 1e-4f ? 1.0f : sinf(PI * t) / (PI * t);
+		float r = t / KAISER_WIDTH;
+		if (r * r >= 1.0f)
+			return 0.0f;
+		return sinc * BesselI0(KAISER_ALPHA * sqrtf(1.0f - r * r)) / BesselI0(KAISER_ALPHA);
+	}
+
+	void BuildTaps(int srcSize, int dstSize, MipFilter filter, vector<FilterTap>& taps)
+	{
+		taps.assign(dstSize, FilterTap());
+		float scale = (float)srcSize / dstSize;
+		for (int d = 0; d < dstSize; d++)
+		{
+			FilterTap& tap = taps[d];
+			float center = (d + 0.5f) * scale;
+			if (srcSize == dstSize)
+			{
+				tap.index.push_back(d);
+				tap.weight.push_back(1.0f);
+				continue;
+			}
+
+			float radius = filter == MIP_FILTER_BOX ? scale * 0.5f : KAISER_WIDTH * scale;
+			int first = (int)floor(center - radius), last = (int)ceil(center + radius);
+			float sum = 0.0f;
+			for (int i = first; i <= last; i++)
+			{
+				float w;
+				if (filter == MIP_FILTER_BOX)
+					w = max(0.0f, min((float)i + 1.0f, center + radius) - max((float)i, center - radius));
+				else
+					w = KaiserSinc((i + 0.5f - center) / scale);
+				if (w == 0.0f)
+					continue;
+
+				// clamp to the edge, texels outside the image repeat the border
+				tap.index.push_back(min(max(i, 0), srcSize - 1));
+				tap.weight.push_back(w);
+				sum += w;
+			}
+			for (size_t i = 0; i < tap.weight.size(); i++)
+				tap.weight[i] /= sum;
+		}
+	}
+
+	// Weighted sum of RGBA float texels at base + index * stride
+	inline void FilterTexel(const float* base, size_t stride, const FilterTap& tap, float* dst)
+	{
+#ifdef MIP_USE_SSE
+		__m128 acc = _mm_setzero_ps();
+		for (size_t i = 0; i < tap.index.size(); i++)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(tap.weight[i]), _mm_loadu_ps(base + tap.index[i] * stride)));
+		_mm_storeu_ps(dst, acc);
+#else
+		dst[0] = dst[1] = dst[2] = dst[3] = 0.0f;
+		for (size_t i = 0; i < tap.index.size(); i++)
+		{
+			const float* p = base + tap.index[i] * stride;
+			for (int c = 0; c < 4; c++)
+				dst[c] += tap.weight[i] * p[c];
+		}
+#endif
+	}
+
+	float SrgbToLinear(float v)
+	{
+		return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float LinearToSrgb(float v)
+	{
+		return v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+	}
+
+	struct ColorTables
+	{
+		float toLinear[256];
+		unsigned char toSrgb[LINEAR_TO_SRGB_STEPS + 1];
+
+		explicit ColorTables(bool srgb)
+		{
+			for (int i = 0; i < 256; i++)
+				toLinear[i] = srgb ? SrgbToLinear(i / 255.0f) : i / 255.0f;
+			for (int i = 0; i <= LINEAR_TO_SRGB_STEPS; i++)
+			{
+				float v = (float)i / LINEAR_TO_SRGB_STEPS;
+				toSrgb[i] = (unsigned char)((srgb ? LinearToSrgb(v) : v) * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	void ToLinear(const TextureLevel& level, const ColorTables& tables, vector<float>& dst)
+	{
+		size_t count = (size_t)level.width * level.height;
+		dst.resize(count * 4);
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 3; c++)
+				dst[i * 4 + c] = tables.toLinear[level.data[i * 4 + c]];
+			dst[i * 4 + 3] = level.data[i * 4 + 3] / 255.0f;
+		}
+	}
+
+	void BuildLevel(const vector<float>& src, int width, int height, MipFilter filter, const ColorTables& tables, TextureLevel& level)
+	{
+		vector<FilterTap> tapsX, tapsY;
+		BuildTaps(width, level.width, filter, tapsX);
+		BuildTaps(height, level.height, filter, tapsY);
+
+		// horizontal pass into a level.width x height buffer
+		vector<float> tmp((size_t)level.width * height * 4);
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < level.width; x++)
+				FilterTexel(&src[(size_t)y * width * 4], 4, tapsX[x], &tmp[((size_t)y * level.width + x) * 4]);
+
+		// vertical pass, then back to 8 bits
+		level.data.resize((size_t)level.width * level.height * 4);
+		float texel[4];
+		for (int y = 0; y < level.height; y++)
+		{
+			for (int x = 0; x < level.width; x++)
+			{
+				FilterTexel(&tmp[(size_t)x * 4], (size_t)level.width * 4, tapsY[y], texel);
+				unsigned char* dst = &level.data[((size_t)y * level.width + x) * 4];
+				for (int c = 0; c < 3; c++)
+					dst[c] = tables.toSrgb[(int)(min(max(texel[c], 0.0f), 1.0f) * LINEAR_TO_SRGB_STEPS + 0.5f)];
+				dst[3] = (unsigned char)(min(max(texel[3], 0.0f), 1.0f) * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+void GenerateMipChain(TextureImage& image, MipFilter filter, bool srgb, int threadCount)
+{
+	int width = image.levels[0].width, height = image.levels[0].height;
+	int levelCount = 1;
+	while ((width >> levelCount) > 0 || (height >> levelCount) > 0)
+		levelCount++;
+	image.levels.resize(levelCount);
+	if (levelCount == 1)
+		return;
+
+	ColorTables tables(srgb);
+	vector<float> src;
+	ToLinear(image.levels[0], tables, src);
+
+	for (int i = 1; i < levelCount; i++)
+	{
+		image.levels[i].width = max(1, width >> i);
+		image.levels[i].height = max(1, height >> i);
+	}
+
+	// the levels only read level 0, so each thread takes the next unbuilt one
+	atomic<int> nextLevel(1);
+	auto worker = [&]()
+	{
+		int i;
+		while ((i = nextLevel++) < levelCount)
+			BuildLevel(src, width, height, filter, tables, image.levels[i]);
+	};
+
+	if (threadCount <= 0)
+		threadCount = (int)thread::hardware_concurrency();
+	threadCount = max(1, min(threadCount, levelCount - 1));
+	vector<thread> threads;
+	for (int i = 1; i < threadCount; i++)
+		threads.push_back(thread(worker));
+	worker();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+void ResampleLevel(const TextureLevel& src, TextureLevel& dst, MipFilter filter, bool srgb)
+{
+	ColorTables tables(srgb);
+	vector<float> linear;
+	ToLinear(src, tables, linear);
+	BuildLevel(linear, src.width, src.height, filter, tables, dst);
+}
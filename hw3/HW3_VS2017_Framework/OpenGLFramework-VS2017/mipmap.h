@@ -0,0 +1,23 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include "texturecache.h"
+
+// CPU mip chain generation for RGBA8 images
+// Every level is filtered straight from level 0 with a separable kernel, so the levels are
+// independent and get spread over threadCount threads (0 means one per hardware thread).
+// With srgb set, colour channels are filtered in linear space and encoded back; alpha is always linear.
+
+enum MipFilter
+{
+	MIP_FILTER_BOX = 0,
+	MIP_FILTER_KAISER = 1
+};
+
+// image.levels[0] must hold TEXEL_RGBA8 data; levels 1 .. 1x1 are (re)built after it
+void GenerateMipChain(TextureImage& image, MipFilter filter, bool srgb, int threadCount);
+
+// Resample an RGBA8 level to dst.width x dst.height with the same kernels
+void ResampleLevel(const TextureLevel& src, TextureLevel& dst, MipFilter filter, bool srgb);
+
+#endif
@@ -0,0 +1,533 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+#include "Vectors.h"
+#include "tiny_obj_loader.h"
+#include "normalbaker.h"
+
+using namespace std;
+
+namespace
+{
+	// Triangle soup: three entries per triangle in every array
+	struct BakeMesh
+	{
+		vector<Vector3> positions;
+		vector<Vector3> normals;
+		vector<Vector2> texCoords;
+		bool hasTexCoord = false;
+
+		int triangleCount() const { return (int)positions.size() / 3; }
+	};
+
+	struct BVHNode
+	{
+		Vector3 boundMin;
+		Vector3 boundMax;
+		int start;		// first entry in triIndex for leaves, right child for inner nodes
+		int count;		// 0 for inner nodes, the left child is always the next node
+	};
+
+	const int BVH_LEAF_SIZE = 4;
+	const int BVH_STACK_SIZE = 64;
+
+	bool LoadBakeMesh(const string& path, BakeMesh& mesh)
+	{
+		tinyobj::attrib_t attrib;
+		vector<tinyobj::shape_t> shapes;
+		vector<tinyobj::material_t> materials;
+		string warn, err;
+		string base_dir = path.substr(0, path.find_last_of("/\\") + 1);
+
+		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), base_dir.c_str());
+		if (!err.empty())
+			cerr << err << endl;
+		if (!ret)
+			return false;
+
+		// ColorModels come without normals, so build area weighted vertex normals for them
+		vector<Vector3> smooth;
+		if (attrib.normals.empty())
+		{
+			smooth.assign(attrib.vertices.size() / 3, Vector3());
+			for (size_t s = 0; s < shapes.size(); s++)
+			{
+				const vector<tinyobj::index_t>& indices = shapes[s].mesh.indices;
+				for (size_t i = 0; i + 2 < indices.size(); i += 3)
+				{
+					int a = indices[i].vertex_index, b = indices[i + 1].vertex_index, c = indices[i + 2].vertex_index;
+					Vector3 pa(attrib.vertices[3 * a], attrib.vertices[3 * a + 1], attrib.vertices[3 * a + 2]);
+					Vector3 pb(attrib.vertices[3 * b], attrib.vertices[3 * b + 1], attrib.vertices[3 * b + 2]);
+					Vector3 pc(attrib.vertices[3 * c], attrib.vertices[3 * c + 1], attrib.vertices[3 * c + 2]);
+					Vector3 n = (pb - pa).cross(pc - pa);
+					smooth[a] += n;
+					smooth[b] += n;
+					smooth[c] += n;
+				}
+			}
+			for (size_t i = 0; i < smooth.size(); i++)
+				smooth[i].normalize();
+		}
+
+		mesh.hasTexCoord = !attrib.texcoords.empty();
+		for (size_t s = 0; s < shapes.size(); s++)
+		{
+			const vector<tinyobj::index_t>& indices = shapes[s].mesh.indices;
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					tinyobj::index_t idx = indices[i + k];
+					mesh.positions.push_back(Vector3(attrib.vertices[3 * idx.vertex_index + 0], attrib.vertices[3 * idx.vertex_index + 1], attrib.vertices[3 * idx.vertex_index + 2]));
+
+					if (idx.normal_index >= 0)
+						mesh.normals.push_back(Vector3(attrib.normals[3 * idx.normal_index + 0], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2]).normalize());
+					else if (!smooth.empty())
+						mesh.normals.push_back(smooth[idx.vertex_index]);
+					else
+						mesh.normals.push_back(Vector3(0, 0, 1));
+
+					if (idx.texcoord_index >= 0)
+						mesh.texCoords.push_back(Vector2(attrib.texcoords[2 * idx.texcoord_index + 0], attrib.texcoords[2 * idx.texcoord_index + 1]));
+					else
+						mesh.texCoords.push_back(Vector2(0, 0));
+				}
+			}
+		}
+		return true;
+	}
+
+	void NormalizeMesh(BakeMesh& mesh, const Vector3& center, float scale)
+	{
+		for (size_t i = 0; i < mesh.positions.size(); i++)
+			mesh.positions[i] = (mesh.positions[i] - center) / scale;
+	}
+
+	void GrowBound(Vector3& boundMin, Vector3& boundMax, const Vector3& p)
+	{
+		boundMin.x = min(boundMin.x, p.x); boundMax.x = max(boundMax.x, p.x);
+		boundMin.y = min(boundMin.y, p.y); boundMax.y = max(boundMax.y, p.y);
+		boundMin.z = min(boundMin.z, p.z); boundMax.z = max(boundMax.z, p.z);
+	}
+
+	class BVH
+	{
+	public:
+		void Build(const BakeMesh& mesh)
+		{
+			this->mesh = &mesh;
+			int count = mesh.triangleCount();
+			triIndex.resize(count);
+			centroids.resize(count);
+			for (int i = 0; i < count; i++)
+			{
+				triIndex[i] = i;
+				centroids[i] = (mesh.positions[3 * i] + mesh.positions[3 * i + 1] + mesh.positions[3 * i + 2]) / 3.0f;
+			}
+			nodes.clear();
+			nodes.reserve(2 * count / BVH_LEAF_SIZE + 1);
+			if (count > 0)
+				BuildNode(0, count, 0);
+		}
+
+		// Closest hit along o + t * d for t in [0, tMax], returns barycentrics of the hit
+		bool Intersect(const Vector3& o, const Vector3& d, float tMax, int& hitTri, float& hitU, float& hitV) const
+		{
+			if (nodes.empty())
+				return false;
+
+			Vector3 invD(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+			int stack[BVH_STACK_SIZE];
+			int top = 0;
+			bool hit = false;
+			stack[top++] = 0;
+
+			while (top > 0)
+			{
+				const BVHNode& node = nodes[stack[--top]];
+				if (!HitBound(node, o, invD, tMax))
+					continue;
+
+				if (node.count > 0)
+				{
+					for (int i = node.start; i < node.start + node.count; i++)
+					{
+						float t, u, v;
+						if (HitTriangle(triIndex[i], o, d, t, u, v) && t <= tMax)
+						{
+							tMax = t;
+							hitTri = triIndex[i];
+							hitU = u;
+							hitV = v;
+							hit = true;
+						}
+					}
+				}
+				else if (top + 2 <= BVH_STACK_SIZE)
+				{
+					int self = (int)(&node - &nodes[0]);
+					stack[top++] = node.start;
+					stack[top++] = self + 1;
+				}
+			}
+			return hit;
+		}
+
+	private:
+		int BuildNode(int start, int count, int depth)
+		{
+			int self = (int)nodes.size();
+			nodes.push_back(BVHNode());
+
+			Vector3 boundMin(FLT_MAX, FLT_MAX, FLT_MAX), boundMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			Vector3 centerMin = boundMin, centerMax = boundMax;
+			for (int i = start; i < start + count; i++)
+			{
+				int tri = triIndex[i];
+				GrowBound(boundMin, boundMax, mesh->positions[3 * tri]);
+				GrowBound(boundMin, boundMax, mesh->positions[3 * tri + 1]);
+				GrowBound(boundMin, boundMax, mesh->positions[3 * tri + 2]);
+				GrowBound(centerMin, centerMax, centroids[tri]);
+			}
+			nodes[self].boundMin = boundMin;
+			nodes[self].boundMax = boundMax;
+
+			// keep the tree shallower than the traversal stack
+			if (count <= BVH_LEAF_SIZE || depth >= BVH_STACK_SIZE / 2 - 1)
+			{
+				nodes[self].start = start;
+				nodes[self].count = count;
+				return self;
+			}
+
+			// median split on the widest centroid axis
+			Vector3 extent = centerMax - centerMin;
+			int axis = 0;
+			if (extent.y > extent.x)
+				axis = 1;
+			if (extent.z > extent[axis])
+				axis = 2;
+
+			int mid = start + count / 2;
+			nth_element(triIndex.begin() + start, triIndex.begin() + mid, triIndex.begin() + start + count,
+				[&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+			BuildNode(start, mid - start, depth + 1);
+			int right = BuildNode(mid, start + count - mid, depth + 1);
+			nodes[self].start = right;
+			nodes[self].count = 0;
+			return self;
+		}
+
+		static bool HitBound(const BVHNode& node, const Vector3& o, const Vector3& invD, float tMax)
+		{
+			float tNear = 0.0f, tFar = tMax;
+			for (int a = 0; a < 3; a++)
+			{
+				float t0 = (node.boundMin[a] - o[a]) * invD[a];
+				float t1 = (node.boundMax[a] - o[a]) * invD[a];
+				if (t0 > t1)
+					swap(t0, t1);
+				tNear = max(tNear, t0);
+				tFar = min(tFar, t1);
+				if (tNear > tFar)
+					return false;
+			}
+			return true;
+		}
+
+		// Moller-Trumbore, two sided
+		bool HitTriangle(int tri, const Vector3& o, const Vector3& d, float& t, float& u, float& v) const
+		{
+			const Vector3& p0 = mesh->positions[3 * tri];
+			Vector3 e1 = mesh->positions[3 * tri + 1] - p0;
+			Vector3 e2 = mesh->positions[3 * tri + 2] - p0;
+			Vector3 p = d.cross(e2);
+			float det = e1.dot(p);
+			if (fabs(det) < 1e-12f)
+				return false;
+
+			float invDet = 1.0f / det;
+			Vector3 s = o - p0;
+			u = s.dot(p) * invDet;
+			if (u < 0.0f || u > 1.0f)
+				return false;
+
+			Vector3 q = s.cross(e1);
+			v = d.dot(q) * invDet;
+			if (v < 0.0f || u + v > 1.0f)
+				return false;
+
+			t = e2.dot(q) * invDet;
+			return t >= 0.0f;
+		}
+
+		const BakeMesh* mesh = NULL;
+		vector<int> triIndex;
+		vector<Vector3> centroids;
+		vector<BVHNode> nodes;
+	};
+
+	// Per low-res triangle data needed to rasterize it in texture space
+	struct BakeTriangle
+	{
+		Vector2 uv[3];
+		float invArea;
+		Vector3 tangent;
+		Vector3 bitangent;
+		bool valid;
+	};
+
+	BakeTriangle SetupTriangle(const BakeMesh& mesh, int tri)
+	{
+		BakeTriangle res;
+		for (int k = 0; k < 3; k++)
+			res.uv[k] = mesh.texCoords[3 * tri + k];
+
+		Vector2 d1 = res.uv[1] - res.uv[0];
+		Vector2 d2 = res.uv[2] - res.uv[0];
+		float area = d1.x * d2.y - d2.x * d1.y;
+		res.valid = fabs(area) > 1e-12f;
+		res.invArea = res.valid ? 1.0f / area : 0.0f;
+
+		Vector3 e1 = mesh.positions[3 * tri + 1] - mesh.positions[3 * tri];
+		Vector3 e2 = mesh.positions[3 * tri + 2] - mesh.positions[3 * tri];
+		res.tangent = (e1 * d2.y - e2 * d1.y) * res.invArea;
+		res.bitangent = (e2 * d1.x - e1 * d2.x) * res.invArea;
+		return res;
+	}
+
+	bool TexelInTriangle(const BakeTriangle& tri, const Vector2& p, float& b0, float& b1, float& b2)
+	{
+		const float eps = -1e-5f;
+		b1 = ((p.x - tri.uv[0].x) * (tri.uv[2].y - tri.uv[0].y) - (tri.uv[2].x - tri.uv[0].x) * (p.y - tri.uv[0].y)) * tri.invArea;
+		b2 = ((tri.uv[1].x - tri.uv[0].x) * (p.y - tri.uv[0].y) - (p.x - tri.uv[0].x) * (tri.uv[1].y - tri.uv[0].y)) * tri.invArea;
+		b0 = 1.0f - b1 - b2;
+		return b0 >= eps && b1 >= eps && b2 >= eps;
+	}
+
+	bool WriteBMP(const string& path, int width, int height, const vector<unsigned char>& rgb)
+	{
+		ofstream file(path.c_str(), ios::binary);
+		if (!file)
+			return false;
+
+		int rowSize = (width * 3 + 3) & ~3;
+		unsigned int imageSize = rowSize * height;
+		unsigned char header[54] = { 'B', 'M' };
+		unsigned int fileSize = 54 + imageSize;
+		unsigned int fields[] = { fileSize, 0, 54, 40, (unsigned int)width, (unsigned int)height };
+		for (int i = 0; i < 6; i++)
+			for (int b = 0; b < 4; b++)
+				header[2 + 4 * i + b] = (unsigned char)(fields[i] >> (8 * b));
+		header[26] = 1;		// planes
+		header[28] = 24;	// bits per pixel
+		for (int b = 0; b < 4; b++)
+			header[34 + b] = (unsigned char)(imageSize >> (8 * b));
+		file.write((const char*)header, 54);
+
+		// rows are stored bottom-up, which is the flipped order the texture decode expects
+		vector<unsigned char> row(rowSize, 0);
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				const unsigned char* src = &rgb[3 * (y * width + x)];
+				row[3 * x + 0] = src[2];
+				row[3 * x + 1] = src[1];
+				row[3 * x + 2] = src[0];
+			}
+			file.write((const char*)&row[0], rowSize);
+		}
+		return (bool)file;
+	}
+
+	void Dilate(int width, int height, vector<unsigned char>& rgb, vector<unsigned char>& covered)
+	{
+		const int dx[] = { -1, 1, 0, 0 };
+		const int dy[] = { 0, 0, -1, 1 };
+		vector<unsigned char> next = covered;
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				if (covered[y * width + x])
+					continue;
+
+				int sum[3] = { 0, 0, 0 }, n = 0;
+				for (int k = 0; k < 4; k++)
+				{
+					int nx = x + dx[k], ny = y + dy[k];
+					if (nx < 0 || ny < 0 || nx >= width || ny >= height || !covered[ny * width + nx])
+						continue;
+					for (int c = 0; c < 3; c++)
+						sum[c] += rgb[3 * (ny * width + nx) + c];
+					n++;
+				}
+				if (n > 0)
+				{
+					for (int c = 0; c < 3; c++)
+						rgb[3 * (y * width + x) + c] = (unsigned char)(sum[c] / n);
+					next[y * width + x] = 1;
+				}
+			}
+		}
+		covered.swap(next);
+	}
+}
+
+bool BakeNormalMap(const string& low_path, const string& high_path, const string& out_path, const BakeSetting& setting)
+{
+	if (setting.width < 1 || setting.height < 1 || setting.width > MAX_BAKE_SIZE || setting.height > MAX_BAKE_SIZE)
+	{
+		cout << "BakeNormalMap: Size " << setting.width << " x " << setting.height << " must be within 1 .. " << MAX_BAKE_SIZE << endl;
+		return false;
+	}
+
+	chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+	BakeMesh low, high;
+	if (!LoadBakeMesh(low_path, low) || !LoadBakeMesh(high_path, high))
+	{
+		cout << "BakeNormalMap: Cannot load " << low_path << " or " << high_path << endl;
+		return false;
+	}
+	if (!low.hasTexCoord)
+	{
+		cout << "BakeNormalMap: " << low_path << " has no texture coordinates to bake into" << endl;
+		return false;
+	}
+	if (high.triangleCount() == 0)
+		return false;
+
+	// normalize both meshes with the high-res bounds so they stay aligned
+	Vector3 boundMin(FLT_MAX, FLT_MAX, FLT_MAX), boundMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < high.positions.size(); i++)
+		GrowBound(boundMin, boundMax, high.positions[i]);
+	Vector3 extent = boundMax - boundMin;
+	float scale = max(extent.x, max(extent.y, extent.z)) / 2;
+	NormalizeMesh(high, (boundMax + boundMin) / 2, scale);
+	NormalizeMesh(low, (boundMax + boundMin) / 2, scale);
+
+	BVH bvh;
+	bvh.Build(high);
+
+	const int width = setting.width, height = setting.height, tileSize = setting.tileSize;
+	const int tilesX = (width + tileSize - 1) / tileSize;
+	const int tilesY = (height + tileSize - 1) / tileSize;
+
+	// bin low-res triangles into the tiles their uv bounds touch
+	vector<BakeTriangle> triangles(low.triangleCount());
+	vector<vector<int> > tileTriangles(tilesX * tilesY);
+	for (int t = 0; t < low.triangleCount(); t++)
+	{
+		triangles[t] = SetupTriangle(low, t);
+		if (!triangles[t].valid)
+			continue;
+
+		const Vector2* uv = triangles[t].uv;
+		int x0 = max(0, (int)floor(min(uv[0].x, min(uv[1].x, uv[2].x)) * width) / tileSize);
+		int x1 = min(tilesX - 1, (int)floor(max(uv[0].x, max(uv[1].x, uv[2].x)) * width) / tileSize);
+		int y0 = max(0, (int)floor(min(uv[0].y, min(uv[1].y, uv[2].y)) * height) / tileSize);
+		int y1 = min(tilesY - 1, (int)floor(max(uv[0].y, max(uv[1].y, uv[2].y)) * height) / tileSize);
+		for (int ty = y0; ty <= y1; ty++)
+			for (int tx = x0; tx <= x1; tx++)
+				tileTriangles[ty * tilesX + tx].push_back(t);
+	}
+
+	vector<unsigned char> rgb(3 * width * height);
+	vector<unsigned char> covered(width * height, 0);
+	atomic<int> nextTile(0);
+	atomic<int> missCount(0);
+
+	auto worker = [&]()
+	{
+		int tile;
+		while ((tile = nextTile++) < tilesX * tilesY)
+		{
+			const vector<int>& list = tileTriangles[tile];
+			if (list.empty())
+				continue;
+
+			int tx = tile % tilesX, ty = tile / tilesX;
+			for (int y = ty * tileSize; y < min(height, (ty + 1) * tileSize); y++)
+			{
+				for (int x = tx * tileSize; x < min(width, (tx + 1) * tileSize); x++)
+				{
+					Vector2 p((x + 0.5f) / width, (y + 0.5f) / height);
+					for (size_t i = 0; i < list.size(); i++)
+					{
+						const BakeTriangle& tri = triangles[list[i]];
+						float b0, b1, b2;
+						if (!TexelInTriangle(tri, p, b0, b1, b2))
+							continue;
+
+						int base = 3 * list[i];
+						Vector3 P = low.positions[base] * b0 + low.positions[base + 1] * b1 + low.positions[base + 2] * b2;
+						Vector3 N = (low.normals[base] * b0 + low.normals[base + 1] * b1 + low.normals[base + 2] * b2).normalize();
+						Vector3 T = (tri.tangent - N * N.dot(tri.tangent)).normalize();
+						Vector3 B = N.cross(T);
+						if (B.dot(tri.bitangent) < 0.0f)
+							B = -B;
+
+						// start outside the surface and shoot inwards, the closest hit wins
+						Vector3 H = N;
+						int hitTri;
+						float u, v;
+						if (bvh.Intersect(P + N * setting.maxDistance, -N, 2 * setting.maxDistance, hitTri, u, v))
+							H = (high.normals[3 * hitTri] * (1 - u - v) + high.normals[3 * hitTri + 1] * u + high.normals[3 * hitTri + 2] * v).normalize();
+						else
+							missCount++;
+
+						Vector3 tangentNormal = Vector3(H.dot(T), H.dot(B), H.dot(N)).normalize();
+						unsigned char* dst = &rgb[3 * (y * width + x)];
+						dst[0] = (unsigned char)((tangentNormal.x * 0.5f + 0.5f) * 255.0f + 0.5f);
+						dst[1] = (unsigned char)((tangentNormal.y * 0.5f + 0.5f) * 255.0f + 0.5f);
+						dst[2] = (unsigned char)((tangentNormal.z * 0.5f + 0.5f) * 255.0f + 0.5f);
+						covered[y * width + x] = 1;
+						break;
+					}
+				}
+			}
+		}
+	};
+
+	int threadCount = setting.threadCount > 0 ? setting.threadCount : (int)thread::hardware_concurrency();
+	threadCount = max(1, threadCount);
+	vector<thread> workers;
+	for (int i = 0; i < threadCount; i++)
+		workers.push_back(thread(worker));
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	for (int i = 0; i < setting.dilation; i++)
+		Dilate(width, height, rgb, covered);
+
+	// flat normal for texels no triangle covers
+	for (int i = 0; i < width * height; i++)
+	{
+		if (!covered[i])
+		{
+			rgb[3 * i + 0] = 128;
+			rgb[3 * i + 1] = 128;
+			rgb[3 * i + 2] = 255;
+		}
+	}
+
+	if (!WriteBMP(out_path, width, height, rgb))
+	{
+		cout << "BakeNormalMap: Cannot write " << out_path << endl;
+		return false;
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	printf("Bake Normal Map Success ! %s (%dx%d) from %d to %d triangles, %d threads, %d missed rays, %.2fs\n",
+		out_path.c_str(), width, height, low.triangleCount(), high.triangleCount(), threadCount, missCount.load(), seconds);
+	return true;
+}
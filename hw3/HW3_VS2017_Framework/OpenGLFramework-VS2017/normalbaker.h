@@ -0,0 +1,25 @@
+#ifndef NORMAL_BAKER_H
+#define NORMAL_BAKER_H
+
+#include <string>
+
+#define MAX_BAKE_SIZE 8192	// largest side of a baked map, 8192 x 8192 is 192 MB of texels
+
+struct BakeSetting
+{
+	int width = 512;
+	int height = 512;
+	int tileSize = 32;			// texels per tile side, one tile is one unit of work
+	int threadCount = 0;		// 0 means one worker per hardware thread
+	float maxDistance = 0.05f;	// ray search distance in normalized model space
+	int dilation = 4;			// texels to grow the baked islands, hides seams in the mips
+};
+
+// Ray-cast from the low-res mesh (which must have texture coordinates) onto the high-res mesh
+// and write a tangent-space normal map as a 24-bit BMP.
+// Both meshes are normalized with the high-res bounding box, the same way LoadTexturedModels does,
+// and the output is laid out bottom-up so the texture streaming samples it with the mesh's own texCoord.
+// Fails for a size outside 1 .. MAX_BAKE_SIZE.
+bool BakeNormalMap(const std::string& low_path, const std::string& high_path, const std::string& out_path, const BakeSetting& setting);
+
+#endif
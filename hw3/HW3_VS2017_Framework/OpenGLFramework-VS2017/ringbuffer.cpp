@@ -0,0 +1,189 @@
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "ringbuffer.h"
+#include "globject.h"
+#include "glinfo.h"
+
+using namespace std;
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace
+{
+	typedef void (APIENTRYP PFNBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+	PFNBUFFERSTORAGEPROC bufferStorage = NULL;
+
+	GLBuffer ringBuffer;
+	size_t regionBytes = 0;
+	unsigned char* mapped = NULL;	// whole ring when persistent, NULL otherwise
+	vector<unsigned char> staging;	// CPU copy of the current region without buffer storage
+	GLsync fences[RING_REGIONS] = {};
+
+	int region = 0;
+	size_t head = 0;		// next free byte inside the region
+	size_t flushed = 0;		// bytes of the region already written to the buffer, fallback path only
+	int stalls = 0;
+	size_t frameBytes = 0;
+	size_t lastFrameBytes = 0;
+
+	// Start writing region r, once the GPU has finished reading it
+	void EnterRegion(int r)
+	{
+		region = r;
+		head = flushed = 0;
+		if (mapped == NULL)
+		{
+			// the GPU may still read the other regions, fresh storage on wrap lets them all be rewritten
+			if (r == 0)
+			{
+				glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+				glBufferData(GL_COPY_WRITE_BUFFER, RING_REGIONS * regionBytes, NULL, GL_STREAM_DRAW);
+			}
+			return;
+		}
+		if (fences[r] == 0)
+			return;
+
+		GLenum status = glClientWaitSync(fences[r], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			stalls++;
+			while (status == GL_TIMEOUT_EXPIRED)
+				status = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		glDeleteSync(fences[r]);
+		fences[r] = 0;
+	}
+
+	// Fence what was written to the current region and continue in the next one
+	void NextRegion()
+	{
+		FlushRing();
+		if (mapped != NULL)
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		EnterRegion((region + 1) % RING_REGIONS);
+	}
+}
+
+bool InitRingBuffer(size_t region_bytes)
+{
+	if (GetGLVersion() >= 44 || HasExtension("GL_ARB_buffer_storage"))
+		bufferStorage = (PFNBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+
+	regionBytes = region_bytes;
+	GLOwnerScope owner("ring buffer");
+	ringBuffer.Create();
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+	if (bufferStorage != NULL)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		bufferStorage(GL_COPY_WRITE_BUFFER, RING_REGIONS * regionBytes, NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, RING_REGIONS * regionBytes, flags);
+		if (mapped == NULL)
+		{
+			cout << "InitRingBuffer: Persistent mapping failed, falling back to unsynchronized writes" << endl;
+			ringBuffer.Create();
+			bufferStorage = NULL;
+		}
+		else
+			ringBuffer.SetBytes(RING_REGIONS * regionBytes);
+	}
+	if (mapped == NULL)
+	{
+		cout << "InitRingBuffer: No persistent buffer storage, writing regions unsynchronized and orphaning the ring on wrap" << endl;
+		staging.resize(regionBytes);
+		ringBuffer.SetBytes(RING_REGIONS * regionBytes);
+	}
+
+	EnterRegion(0);
+	return glGetError() != GL_OUT_OF_MEMORY;
+}
+
+bool IsRingPersistent()
+{
+	return mapped != NULL;
+}
+
+GLuint GetRingBuffer()
+{
+	return ringBuffer;
+}
+
+void* AllocateRing(size_t size, size_t alignment, GLintptr& offset)
+{
+	if (size > regionBytes)
+	{
+		cout << "AllocateRing: " << size << " bytes do not fit a region of " << regionBytes << endl;
+		return NULL;
+	}
+
+	size_t start = (head + alignment - 1) & ~(alignment - 1);
+	if (start + size > regionBytes)
+	{
+		// the frame outgrew its region, hand the rest of it to the GPU early
+		NextRegion();
+		start = 0;
+	}
+	head = start + size;
+	frameBytes += size;
+
+	offset = (GLintptr)(region * regionBytes + start);
+	if (mapped != NULL)
+		return mapped + offset;
+	return &staging[start];
+}
+
+void FlushRing()
+{
+	if (mapped != NULL || head == flushed)
+		return;
+	// nothing has read this range since the last orphan, so the write need not wait for the GPU
+	glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	void* dst = glMapBufferRange(GL_COPY_WRITE_BUFFER, region * regionBytes + flushed, head - flushed, access);
+	if (dst != NULL)
+	{
+		memcpy(dst, &staging[flushed], head - flushed);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+	flushed = head;
+}
+
+void EndRingFrame()
+{
+	if (ringBuffer == 0)
+		return;
+	NextRegion();
+	lastFrameBytes = frameBytes;
+	frameBytes = 0;
+}
+
+void DeleteRingBuffer()
+{
+	for (int i = 0; i < RING_REGIONS; i++)
+	{
+		if (fences[i] != 0)
+			glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+	if (mapped != NULL)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+	ringBuffer.Reset();
+	mapped = NULL;
+	staging.clear();
+}
+
+void GetRingStats(int& stall_count, size_t& frame_bytes)
+{
+	stall_count = stalls;
+	frame_bytes = lastFrameBytes;
+}
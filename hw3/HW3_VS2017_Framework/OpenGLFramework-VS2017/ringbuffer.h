@@ -0,0 +1,38 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+// Ring buffer for per-frame dynamic data
+// Transforms and draw commands that change every frame are written into one large buffer instead
+// of being pushed through glUniform calls or fresh buffer uploads. With GL 4.4 or
+// GL_ARB_buffer_storage the buffer is mapped once, persistent and coherent, and split into
+// RING_REGIONS regions: a frame writes one region while the GPU still reads the previous ones, and
+// a fence placed at the end of each region keeps the CPU from overwriting it before the GPU is done.
+// Without buffer storage, allocations go to a CPU copy of the region that FlushRing writes into the
+// buffer through an unsynchronized mapping: every range is written once before any draw reads it,
+// so the write never has to wait for the GPU. The buffer is orphaned only when the ring wraps back to
+// its first region, which hands the driver fresh storage instead of a fence per region.
+
+#define RING_REGIONS 3
+
+// Create the ring with region_bytes per frame, needs a current context
+bool InitRingBuffer(size_t region_bytes);
+bool IsRingPersistent();
+GLuint GetRingBuffer();
+
+// size bytes for data of the current frame at an offset aligned to alignment (a power of two).
+// The returned memory is valid until FlushRing; offset is where the data lands in GetRingBuffer()
+void* AllocateRing(size_t size, size_t alignment, GLintptr& offset);
+// Make the data written since the last flush visible to GL, call it before the draws that read it
+void FlushRing();
+// Fence the frame's region and move on to the next one
+void EndRingFrame();
+
+void DeleteRingBuffer();
+
+// Regions that were still in use by the GPU when the CPU came back to them, and bytes of the last frame
+void GetRingStats(int& stalls, size_t& frame_bytes);
+
+#endif
@@ -1,15 +1,21 @@
 #version 330
 
+// Permutation defines as listed in shader.vs.glsl
+
 out vec4 FragColor;
 in vec3 vertex_view;
 in vec3 vertex_normal;
 in vec4 V_color;
 in vec2 texCoord;
+#ifdef DUAL_VIEW
+flat in int shading_mode;	// 0 per vertex, 1 per pixel
+#endif
 
 struct LightInfo
 {
-	vec3 position;
-	vec3 spotDirection;
+	vec3 position;		// view space
+	int type;			// 0 directional, 1 point, 2 spot
+	vec3 spotDirection;	// view space, normalized
 	vec3 Ambient;		
 	vec3 Diffuse;			
 	vec3 Specular;		
@@ -26,33 +32,53 @@ struct MaterialInfo
 	vec3 Kd;
 	vec3 Ks;
 	float shininess;
-	int diffuseTexture;
+	int diffuseLayer;
 };
 
-uniform int light_type;		
-uniform mat4 view_matrix;		
-uniform LightInfo light[3];
-uniform MaterialInfo material;
-uniform int vertex_or_perpixel;
-uniform sampler2D tex;	
+#define MAX_LIGHTS 32
+#define MAX_MATERIALS 128
+
+// std140 mirrors are in uniformblocks.h
+layout (std140) uniform TransformBlock
+{
+	mat4 model_view;
+	mat4 normal_matrix;	// transpose(inverse(model_view)), computed per draw on the CPU
+	mat4 mvp;
+};
+
+layout (std140) uniform LightBlock
+{
+	LightInfo light[MAX_LIGHTS];
+	int lightCount;
+};
 
-vec4 directionalLight(vec3 N, vec3 V)
+layout (std140) uniform MaterialBlock
 {
-	vec4 lightInView = view_matrix * vec4(light[0].position,1.0f);	
+	MaterialInfo materials[MAX_MATERIALS];
+};
+
+flat in int draw_material;	// entry of materials the current draw uses
+uniform sampler2DArray tex;	
+
+MaterialInfo material;
+
+vec4 directionalLight(LightInfo l, vec3 N, vec3 V)
+{
+	vec3 lightInView = l.position;
 	vec3 S = normalize(lightInView.xyz + V);			
 	vec3 H = normalize(S + V);						
 
 	float dc = dot(S,N);	
 	float sc = pow(max(dot(H, N), 0), material.shininess);
-	vec3 color = light[0].Ambient * material.Ka + dc * light[0].Diffuse * material.Kd + sc * light[0].Specular * material.Ks;
+	vec3 color = l.Ambient * material.Ka + dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks;
 	vec4 output_color = vec4(color, 1.0f);
 
 	return output_color;
 }
 
-vec4 pointLight(vec3 N, vec3 V)
+vec4 pointLight(LightInfo l, vec3 N, vec3 V)
 {
-	vec4 lightInView = view_matrix * vec4(light[1].position,1.0f);	
+	vec3 lightInView = l.position;
 	vec3 S = normalize(lightInView.xyz + V);			
 	vec3 H = normalize(S + V);						
 
@@ -60,66 +86,85 @@ vec4 pointLight(vec3 N, vec3 V)
 	float sc = pow(max(dot(H, N), 0), material.shininess);
 
 	float dis = length(lightInView.xyz + V);
-	float f = 1/ (light[1].constantAttenuation + light[1].linearAttenuation*dis + pow(dis, 2)*light[1].quadraticAttenuation);
-	vec3 color = f * (light[1].Ambient * material.Ka + dc * light[1].Diffuse * material.Kd + sc * light[1].Specular * material.Ks);
+	float f = 1/ (l.constantAttenuation + l.linearAttenuation*dis + pow(dis, 2)*l.quadraticAttenuation);
+	vec3 color = f * (l.Ambient * material.Ka + dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks);
 	vec4 output_color = vec4(color, 1.0f);
 
 	return output_color;
 }
 
-vec4 spotLight(vec3 N, vec3 V)
+vec4 spotLight(LightInfo l, vec3 N, vec3 V)
 {
-	vec4 lightInView = view_matrix * vec4(light[2].position,1.0f);	
+	vec3 lightInView = l.position;
 	vec3 S = normalize(lightInView.xyz + V);			
 	vec3 H = normalize(S + V);
 
 	float dc = dot(S,N);	
 	float sc = pow(max(dot(H, N), 0), material.shininess);
 
-	float spot = dot(-S, normalize(light[2].spotDirection.xyz));
+	float spot = dot(-S, l.spotDirection);
 	float dis = length(lightInView.xyz + V);
-	float f = 1/ (light[2].constantAttenuation + light[2].linearAttenuation*dis + pow(dis, 2)*light[2].quadraticAttenuation);
+	float f = 1/ (l.constantAttenuation + l.linearAttenuation*dis + pow(dis, 2)*l.quadraticAttenuation);
 
 	vec3 color;
-	if(spot < light[2].spotCutoff)
-		color = light[2].Ambient * material.Ka + f * 0 * ( dc * light[2].Diffuse * material.Kd + sc * light[2].Specular * material.Ks);
+	if(spot < l.spotCutoff)
+		color = l.Ambient * material.Ka + f * 0 * ( dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks);
 	else
-		color = light[2].Ambient * material.Ka + f * pow(max(spot, 0), light[2].spotExponent) * (dc * light[2].Diffuse * material.Kd + sc * light[2].Specular * material.Ks);
+		color = l.Ambient * material.Ka + f * pow(max(spot, 0), l.spotExponent) * (dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks);
 	
 	vec4 output_color = vec4(color, 1.0f);
 
 	return output_color;
 }
 
-// [TODO] passing texture from main.cpp
-// Hint: sampler2D
-
-void main() 
+vec4 perPixelLighting()
 {
-	//FragColor = vec4(vertex_normal, 1.0f);
-
 	vec3 N = normalize(vertex_normal);	
 	vec3 V = -vertex_view;
 	//vec3 V = normalize(-vertex_view);
 	vec4 color = vec4(0, 0, 0, 0);
 
-	// Handle lighting mode type
-	if(light_type == 0)
-		color += directionalLight(N, V);
-	else if(light_type == 1)
-		color += pointLight(N, V);
-	else if(light_type == 2)
-		color += spotLight(N ,V);
+	// Handle lighting mode type, every light of the selected type contributes
+	for(int i = 0; i < lightCount; i++)
+	{
+		if(light[i].type != LIGHT_TYPE)
+			continue;
+#if LIGHT_TYPE == 0
+		color += directionalLight(light[i], N, V);
+#elif LIGHT_TYPE == 1
+		color += pointLight(light[i], N, V);
+#else
+		color += spotLight(light[i], N ,V);
+#endif
+	}
+	return color;
+}
+
+// [TODO] passing texture from main.cpp
+// Hint: sampler2D
+
+void main() 
+{
+	material = materials[draw_material];
+	//FragColor = vec4(vertex_normal, 1.0f);
 
-	if(vertex_or_perpixel == 0)
+#if defined(DUAL_VIEW)
+	if(shading_mode == 0)
 		FragColor = V_color;
 	else
-		FragColor = color;
+		FragColor = perPixelLighting();
+#elif defined(PER_VERTEX)
+	FragColor = V_color;
+#else
+	FragColor = perPixelLighting();
+#endif
 
 	//FragColor = vec4(texCoord.xy, 0, 1);
 
 	// [TODO] sampling from texture
 	// Hint: texture
-	vec4 texColor = vec4(texture(tex, texCoord).rgb, 1.0);
+#ifdef TEXTURED
+	vec4 texColor = vec4(texture(tex, vec3(texCoord, material.diffuseLayer)).rgb, 1.0);
 	FragColor = FragColor * texColor;
+#endif
 }
\ No newline at end of file
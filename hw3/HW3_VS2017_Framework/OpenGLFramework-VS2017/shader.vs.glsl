@@ -1,13 +1,25 @@
 #version 330
 
+// Permutation defines, inserted after #version by shadervariants.cpp:
+// LIGHT_TYPE			0 directional, 1 point, 2 spot
+// PER_VERTEX			Gouraud shading only, the fragment shader passes V_color on
+// PER_PIXEL			Phong shading only, this shader does no lighting
+// DUAL_VIEW			both halves in one pass, even instances per vertex and odd ones per pixel
+// TEXTURED				the diffuse map is sampled
+// VERTEX_COLOR, VERTEX_NORMAL, VERTEX_TEXCOORD	attributes of the vertex format
+
 layout (location = 0) in vec3 aPos;
+#ifdef VERTEX_COLOR
 layout (location = 1) in vec3 aColor;
+#endif
+#ifdef VERTEX_NORMAL
 layout (location = 2) in vec3 aNormal;
+#endif
+#ifdef VERTEX_TEXCOORD
 layout (location = 3) in vec2 aTexCoord;
-
-uniform mat4 um4p;	// projection matrix
-uniform mat4 um4v;	// camera viewing transformation matrix
-uniform mat4 um4m;	// rotation matrix
+#endif
+layout (location = 4) in vec4 aInstance;	// stress grid offset in xyz and scale in w, (0, 0, 0, 1) when off
+layout (location = 5) in int aDrawMaterial;	// material of the command in a multi-draw-indirect
 
 out vec3 vertex_view;
 out vec3 vertex_normal;
@@ -16,8 +28,9 @@ out vec2 texCoord;
 
 struct LightInfo
 {
-	vec3 position;
-	vec3 spotDirection;
+	vec3 position;		// view space
+	int type;			// 0 directional, 1 point, 2 spot
+	vec3 spotDirection;	// view space, normalized
 	vec3 Ambient;		
 	vec3 Diffuse;			
 	vec3 Specular;		
@@ -34,33 +47,58 @@ struct MaterialInfo
 	vec3 Kd;
 	vec3 Ks;
 	float shininess;
-	int diffuseTexture;
+	int diffuseLayer;
 };
 
-uniform int light_type;		
-uniform mat4 view_matrix;
-uniform mat4 model_matrix;
-uniform mat4 mvp;	
-uniform LightInfo light[3];
-uniform MaterialInfo material;
+#define MAX_LIGHTS 32
+#define MAX_MATERIALS 128
+
+// std140 mirrors are in uniformblocks.h
+layout (std140) uniform TransformBlock
+{
+	mat4 model_view;
+	mat4 normal_matrix;	// transpose(inverse(model_view)), computed per draw on the CPU
+	mat4 mvp;
+};
 
-vec4 directionalLight(vec3 N, vec3 V)
+layout (std140) uniform LightBlock
 {
-	vec4 lightInView = view_matrix * vec4(light[0].position,1.0f);	
+	LightInfo light[MAX_LIGHTS];
+	int lightCount;
+};
+
+layout (std140) uniform MaterialBlock
+{
+	MaterialInfo materials[MAX_MATERIALS];
+};
+
+uniform int materialIndex;	// entry of materials the current draw uses, -1 to take aDrawMaterial
+
+#ifdef DUAL_VIEW
+flat out int shading_mode;	// 0 per vertex, 1 per pixel
+#endif
+flat out int draw_material;
+out float gl_ClipDistance[2];
+
+MaterialInfo material;
+
+vec4 directionalLight(LightInfo l, vec3 N, vec3 V)
+{
+	vec3 lightInView = l.position;
 	vec3 S = normalize(lightInView.xyz + V);			
 	vec3 H = normalize(S + V);						
 
 	float dc = dot(S,N);	
 	float sc = pow(max(dot(H, N), 0), material.shininess);
-	vec3 color = light[0].Ambient * material.Ka + dc * light[0].Diffuse * material.Kd + sc * light[0].Specular * material.Ks;
+	vec3 color = l.Ambient * material.Ka + dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks;
 	vec4 output_color = vec4(color, 1.0f);
 
 	return output_color;
 }
 
-vec4 pointLight(vec3 N, vec3 V)
+vec4 pointLight(LightInfo l, vec3 N, vec3 V)
 {
-	vec4 lightInView = view_matrix * vec4(light[1].position,1.0f);	
+	vec3 lightInView = l.position;
 	vec3 S = normalize(lightInView.xyz + V);			
 	vec3 H = normalize(S + V);						
 
@@ -68,31 +106,31 @@ vec4 pointLight(vec3 N, vec3 V)
 	float sc = pow(max(dot(H, N), 0), material.shininess);
 
 	float dis = length(lightInView.xyz + V);
-	float f = 1/ (light[1].constantAttenuation + light[1].linearAttenuation*dis + pow(dis, 2)*light[1].quadraticAttenuation);
-	vec3 color = f * (light[1].Ambient * material.Ka + dc * light[1].Diffuse * material.Kd + sc * light[1].Specular * material.Ks);
+	float f = 1/ (l.constantAttenuation + l.linearAttenuation*dis + pow(dis, 2)*l.quadraticAttenuation);
+	vec3 color = f * (l.Ambient * material.Ka + dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks);
 	vec4 output_color = vec4(color, 1.0f);
 
 	return output_color;
 }
 
-vec4 spotLight(vec3 N, vec3 V)
+vec4 spotLight(LightInfo l, vec3 N, vec3 V)
 {
-	vec4 lightInView = view_matrix * vec4(light[2].position,1.0f);	
+	vec3 lightInView = l.position;
 	vec3 S = normalize(lightInView.xyz + V);			
 	vec3 H = normalize(S + V);
 
 	float dc = dot(S,N);	
 	float sc = pow(max(dot(H, N), 0), material.shininess);
 
-	float spot = dot(-S, normalize(light[2].spotDirection.xyz));
+	float spot = dot(-S, l.spotDirection);
 	float dis = length(lightInView.xyz + V);
-	float f = 1/ (light[2].constantAttenuation + light[2].linearAttenuation*dis + pow(dis, 2)*light[2].quadraticAttenuation);
+	float f = 1/ (l.constantAttenuation + l.linearAttenuation*dis + pow(dis, 2)*l.quadraticAttenuation);
 
 	vec3 color;
-	if(spot < light[2].spotCutoff)
-		color = light[2].Ambient * material.Ka + f * 0 * ( dc * light[2].Diffuse * material.Kd + sc * light[2].Specular * material.Ks);
+	if(spot < l.spotCutoff)
+		color = l.Ambient * material.Ka + f * 0 * ( dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks);
 	else
-		color = light[2].Ambient * material.Ka + f * pow(max(spot, 0), light[2].spotExponent) * (dc * light[2].Diffuse * material.Kd + sc * light[2].Specular * material.Ks);
+		color = l.Ambient * material.Ka + f * pow(max(spot, 0), l.spotExponent) * (dc * l.Diffuse * material.Kd + sc * l.Specular * material.Ks);
 	
 	vec4 output_color = vec4(color, 1.0f);
 
@@ -101,30 +139,65 @@ vec4 spotLight(vec3 N, vec3 V)
 
 void main()
 {
+	draw_material = materialIndex >= 0 ? materialIndex : aDrawMaterial;
+	material = materials[draw_material];
 	// [TODO]
 	V_color = vec4(0, 0, 0, 0);
 	//vertex_normal = aNormal;
 
-	vec4 vertexInView = view_matrix * model_matrix * vec4(aPos.x, aPos.y, aPos.z, 1.0);
-	vec4 normalInView = transpose(inverse(view_matrix * model_matrix)) * vec4(aNormal, 0.0);
+	vec3 position = aPos * aInstance.w + aInstance.xyz;
+	vec4 vertexInView = model_view * vec4(position, 1.0);
+#ifdef VERTEX_NORMAL
+	vec4 normalInView = normal_matrix * vec4(aNormal, 0.0);
+#else
+	vec4 normalInView = vec4(0.0, 0.0, 1.0, 0.0);
+#endif
 
 	vertex_view = vertexInView.xyz;
 	vertex_normal = normalInView.xyz;
 
-	vec3 N = normalize(vertex_normal);
-	vec3 V = -vertex_view;
-	//vec3 V = normalize(-vertex_view);
-
-	// Handle lighting mode type
-	if(light_type == 0)
-		V_color += directionalLight(N, V);
-	else if(light_type == 1)
-		V_color += pointLight(N, V);
-	else if(light_type == 2)
-		V_color += spotLight(N ,V);
-
-	gl_Position = mvp * vec4(aPos.x, aPos.y, aPos.z, 1.0);
-
+	gl_Position = mvp * vec4(position, 1.0);
+
+#ifdef DUAL_VIEW
+	// even instances are the per vertex left half, odd ones the per pixel right half: clip against the
+	// projection's own x range as a half-width viewport would, then squeeze into that half
+	int view = gl_InstanceID % 2;
+	shading_mode = view;
+	gl_ClipDistance[0] = gl_Position.w - gl_Position.x;
+	gl_ClipDistance[1] = gl_Position.w + gl_Position.x;
+	gl_Position.x = 0.5 * gl_Position.x + (view == 0 ? -0.5 : 0.5) * gl_Position.w;
+#endif
+
+#if defined(PER_VERTEX) || defined(DUAL_VIEW)
+#ifdef DUAL_VIEW
+	// the per pixel half gets its lighting in the fragment shader
+	if(view == 0)
+#endif
+	{
+		vec3 N = normalize(vertex_normal);
+		vec3 V = -vertex_view;
+		//vec3 V = normalize(-vertex_view);
+
+		// Handle lighting mode type, every light of the selected type contributes
+		for(int i = 0; i < lightCount; i++)
+		{
+			if(light[i].type != LIGHT_TYPE)
+				continue;
+#if LIGHT_TYPE == 0
+			V_color += directionalLight(light[i], N, V);
+#elif LIGHT_TYPE == 1
+			V_color += pointLight(light[i], N, V);
+#else
+			V_color += spotLight(light[i], N ,V);
+#endif
+		}
+	}
+#endif
+
+#ifdef VERTEX_TEXCOORD
 	texCoord = aTexCoord;
+#else
+	texCoord = vec2(0.0, 0.0);
+#endif
 
 }
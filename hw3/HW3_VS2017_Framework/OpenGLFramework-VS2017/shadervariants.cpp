@@ -0,0 +1,170 @@
+#include <iostream>
+#include <string>
+#include <map>
+#include <stdlib.h>
+#include "shadervariants.h"
+#include "uniformblocks.h"
+#include "vertexformat.h"
+#include "textfile.h"
+
+using namespace std;
+
+namespace
+{
+	const char* VERTEX_SHADER_PATH = "shader.vs.glsl";
+	const char* FRAGMENT_SHADER_PATH = "shader.fs.glsl";
+
+	map<unsigned int, ShaderVariant> variants;
+	string vertexSource;	// read once, every permutation starts from the same text
+	string fragmentSource;
+
+	unsigned int PackKey(const ShaderKey& key)
+	{
+		return (unsigned int)key.lightType | (unsigned int)key.shading << 2 | (key.textured ? 1u : 0u) << 4 | key.vertexMask << 5;
+	}
+
+	bool ReadSource(const char* path, string& source)
+	{
+		if (!source.empty())
+			return true;
+		char* text = textFileRead(path);
+		if (text == NULL)
+		{
+			cout << "GetShaderVariant: Cannot read " << path << endl;
+			return false;
+		}
+		source = text;
+		free(text);
+		return true;
+	}
+
+	string Defines(const ShaderKey& key)
+	{
+		const char* shading[] = { "PER_VERTEX", "PER_PIXEL", "DUAL_VIEW" };
+		string defines = "#define LIGHT_TYPE " + to_string(key.lightType) + "\n";
+		defines += string("#define ") + shading[key.shading] + "\n";
+		if (key.textured)
+			defines += "#define TEXTURED\n";
+		if (key.vertexMask & 1 << ATTRIB_COLOR)
+			defines += "#define VERTEX_COLOR\n";
+		if (key.vertexMask & 1 << ATTRIB_NORMAL)
+			defines += "#define VERTEX_NORMAL\n";
+		if (key.vertexMask & 1 << ATTRIB_TEXCOORD)
+			defines += "#define VERTEX_TEXCOORD\n";
+		return defines;
+	}
+
+	// source with the defines after its #version line, #line keeps error messages at the file's line numbers
+	string InjectDefines(const string& source, const string& defines)
+	{
+		size_t version = source.find("#version");
+		size_t end = version == string::npos ? string::npos : source.find('\n', version);
+		if (end == string::npos)
+			return defines + "#line 1\n" + source;
+		int line = 2;
+		for (size_t i = 0; i < end; i++)
+			line += source[i] == '\n' ? 1 : 0;
+		return source.substr(0, end + 1) + defines + "#line " + to_string(line) + "\n" + source.substr(end + 1);
+	}
+
+	GLShader CompileShader(GLenum type, const string& source, const string& defines)
+	{
+		GLShader shader;
+		shader.Create(type);
+		string text = InjectDefines(source, defines);
+		const GLchar* text_ptr = text.c_str();
+		glShaderSource(shader, 1, &text_ptr, NULL);
+		glCompileShader(shader);
+
+		GLint success;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			char infoLog[1000];
+			glGetShaderInfoLog(shader, 1000, NULL, infoLog);
+			cout << "ERROR: " << (type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << " SHADER COMPILATION FAILED\n" << defines << infoLog << endl;
+			shader.Reset();
+		}
+		return shader;
+	}
+
+	bool BuildVariant(const ShaderKey& key, ShaderVariant& variant)
+	{
+		if (!ReadSource(VERTEX_SHADER_PATH, vertexSource) || !ReadSource(FRAGMENT_SHADER_PATH, fragmentSource))
+			return false;
+
+		GLOwnerScope owner("shaders");
+		string defines = Defines(key);
+		GLShader v = CompileShader(GL_VERTEX_SHADER, vertexSource, defines);
+		GLShader f = CompileShader(GL_FRAGMENT_SHADER, fragmentSource, defines);
+		if (v == 0 || f == 0)
+			return false;
+
+		variant.program.Create();
+		glAttachShader(variant.program, f);
+		glAttachShader(variant.program, v);
+		glLinkProgram(variant.program);
+		v.Reset();
+		f.Reset();
+
+		GLint success;
+		glGetProgramiv(variant.program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			char infoLog[1000];
+			glGetProgramInfoLog(variant.program, 1000, NULL, infoLog);
+			cout << "ERROR: SHADER PROGRAM LINKING FAILED\n" << defines << infoLog << endl;
+			variant.program.Reset();
+			return false;
+		}
+
+		variant.materialIndex = glGetUniformLocation(variant.program, "materialIndex");
+		BindUniformBlocks(variant.program);
+		return true;
+	}
+}
+
+const ShaderVariant* GetShaderVariant(const ShaderKey& key)
+{
+	unsigned int packed = PackKey(key);
+	map<unsigned int, ShaderVariant>::iterator it = variants.find(packed);
+	if (it == variants.end())
+	{
+		// a failed build is cached too, so it is reported once instead of every frame
+		ShaderVariant variant;
+		BuildVariant(key, variant);
+		it = variants.insert(make_pair(packed, move(variant))).first;
+	}
+	return it->second.program == 0 ? NULL : &it->second;
+}
+
+bool PrecompileShaderVariants(unsigned int vertex_mask)
+{
+	bool ok = true;
+	for (int light_type = LIGHT_DIRECTIONAL; light_type <= LIGHT_SPOT; light_type++)
+	{
+		for (int shading = SHADING_PER_VERTEX; shading <= SHADING_DUAL_VIEW; shading++)
+		{
+			for (int textured = 0; textured < 2; textured++)
+			{
+				if (textured == 1 && (vertex_mask & 1 << ATTRIB_TEXCOORD) == 0)
+					continue;
+				ShaderKey key = { light_type, (ShadingMode)shading, textured == 1, vertex_mask };
+				ok = GetShaderVariant(key) != NULL && ok;
+			}
+		}
+	}
+	return ok;
+}
+
+int GetShaderVariantCount()
+{
+	return (int)variants.size();
+}
+
+void DeleteShaderVariants()
+{
+	variants.clear();
+	vertexSource.clear();
+	fragmentSource.clear();
+}
@@ -0,0 +1,45 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <glad/glad.h>
+#include "globject.h"
+
+// Shader permutations
+// shader.vs.glsl and shader.fs.glsl are built once per combination of light type, shading mode,
+// texturing and vertex format. The combination is passed as #defines inserted after #version, so
+// each program only contains the lighting its pass uses instead of branching on uniforms: a per
+// vertex pass does no per pixel lighting and the other way round. Programs are compiled on first
+// use and kept until DeleteShaderVariants.
+
+enum ShadingMode
+{
+	SHADING_PER_VERTEX = 0,
+	SHADING_PER_PIXEL = 1,
+	SHADING_DUAL_VIEW = 2		// both halves in one pass, even instances per vertex and odd ones per pixel
+};
+
+struct ShaderKey
+{
+	int lightType;				// LightType
+	ShadingMode shading;
+	bool textured;				// the diffuse map is sampled, needs a texcoord in the vertex format
+	unsigned int vertexMask;	// VertexFormat::mask of the meshes drawn
+};
+
+struct ShaderVariant
+{
+	GLProgram program;
+	GLint materialIndex = -1;	// uniform location
+};
+
+// Program of the permutation for key, built on first use; NULL if it does not compile or link
+const ShaderVariant* GetShaderVariant(const ShaderKey& key);
+
+// Build every permutation of a vertex format up front, so switching modes never compiles mid-frame.
+// False if one of them failed
+bool PrecompileShaderVariants(unsigned int vertex_mask);
+
+int GetShaderVariantCount();
+void DeleteShaderVariants();
+
+#endif
@@ -0,0 +1,833 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <string.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <STB/stb_image.h>
+#include "texture.h"
+#include "texturecache.h"
+#include "bcencoder.h"
+#include "mipmap.h"
+#include "bmploader.h"
+#include "globject.h"
+#include "glinfo.h"
+#include "glstate.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+using namespace std;
+
+namespace
+{
+	// bytes copied into pixel buffers per UpdateTextureStreaming call
+	const size_t UPLOAD_BUDGET_PER_FRAME = 4 * 1024 * 1024;
+	// mips up to this size go up first and stay resident when a texture is evicted
+	const int TAIL_MIP_SIZE = 64;
+
+	struct TextureEntry
+	{
+		unsigned long long hash;
+		int refCount;
+		GLenum target;		// GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+		GLTexture tex;		// 0 until the first levels are specified
+		int owner;			// GL owner that acquired the texture, its memory is counted there
+		string path;
+		vector<string> sources;	// image file of every layer, read again when an evicted texture comes back
+
+		// mip streaming: levels residentLevel .. levelCount - 1 are sampled, GL_TEXTURE_BASE_LEVEL hides the rest
+		TextureImage image;			// CPU copy of the chain, empty until decoded, after eviction and once level 0 is resident
+		vector<size_t> levelSizes;	// bytes of every level, known after the first decode
+		int width;					// level 0 size
+		int height;
+		int levelCount;				// 0 until the first decode
+		int tailLevel;				// first level of TAIL_MIP_SIZE or smaller, always kept once uploaded
+		int residentLevel;			// levelCount while nothing is resident
+		int wantedLevel;			// finest level the coverage feedback asked for, 0 without feedback
+		int uploadLevel;			// finest level of the upload in flight, -1 if none
+		GLBuffer pbo;
+		GLsync fence;
+
+		// residency
+		int lastUsedFrame;
+		bool evicted;			// image dropped by the memory budget
+		bool requested;			// a decode is queued or in flight
+	};
+
+	struct DecodeJob
+	{
+		TextureHandle handle;
+		unsigned long long hash;
+		vector<string> sources;	// image file of every layer, one for 2D textures
+		string path;
+	};
+
+	struct DecodedImage
+	{
+		TextureHandle handle;
+		TextureImage image;
+		bool valid;
+		string path;
+	};
+
+	map<TextureHandle, TextureEntry> textureByHandle;
+	map<unsigned long long, TextureHandle> handleByHash;
+	TextureHandle nextHandle = 1;
+	GLTexture fallbackTexture;
+	GLTexture fallbackArray;
+	vector<GLBuffer> freePBOs;
+	GLSampler samplers[8];		// indexed by mag_linear | min_linear << 1 | repeat << 2
+	bool compressTextures = false;	// S3TC reported by the driver, read by the workers
+	size_t memoryBudget = 256 * 1024 * 1024;
+	int frameIndex = 0;
+	bool streamingActive = false;	// the last update uploaded or left uploads in flight
+	bool baseLevelsChanged = false;	// a sampled level range changed during the current update
+	void (*decodeNotify)() = NULL;	// called on a worker thread after each decode
+
+	// worker side, guarded by queueMutex
+	mutex queueMutex;
+	condition_variable queueCondition;
+	deque<DecodeJob> decodeQueue;
+	deque<DecodedImage> decodedQueue;
+	vector<thread> workers;
+	bool stopWorkers = false;
+
+	// 64-bit FNV-1a
+	unsigned long long HashBytes(const unsigned char* data, size_t size)
+	{
+		unsigned long long hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	// Hash of a file's content, read through a mapping instead of a copy
+	bool HashFile(const string& path, unsigned long long& hash)
+	{
+		MappedFile file;
+		if (!MapFile(path, file))
+			return false;
+		hash = HashBytes(file.data, file.size);
+		UnmapFile(file);
+		return true;
+	}
+
+	// Key of a texture array: the layer hashes folded in order, seeded apart from plain FNV-1a
+	// so an array never shares a key with a 2D texture
+	unsigned long long HashLayers(const vector<unsigned long long>& hashes)
+	{
+		unsigned long long hash = 14695981039346656037ULL ^ 0x41525241594c5952ULL;
+		for (size_t i = 0; i < hashes.size(); i++)
+		{
+			for (int b = 0; b < 8; b++)
+			{
+				hash ^= (hashes[i] >> (b * 8)) & 0xff;
+				hash *= 1099511628211ULL;
+			}
+		}
+		return hash;
+	}
+
+	void CompressLevels(TextureImage& image, bool opaque)
+	{
+		image.format = opaque ? TEXEL_BC1 : TEXEL_BC3;
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			TextureLevel& level = image.levels[i];
+			vector<unsigned char> blocks(opaque ? BC1Size(level.width, level.height) : BC3Size(level.width, level.height));
+			// runs on a decode worker, which already is one of a pool sized to the cores
+			if (opaque)
+				CompressBC1(&level.data[0], level.width, level.height, &blocks[0], 1);
+			else
+				CompressBC3(&level.data[0], level.width, level.height, &blocks[0], 1);
+			level.data.swap(blocks);
+		}
+	}
+
+	// Decode a whole image file, data is the mapped file
+	bool DecodeLevel(const unsigned char* data, size_t size, TextureLevel& level)
+	{
+		BmpImage bmp;
+		if (ParseBmp(data, size, bmp))
+		{
+			// bottom-up rows are already in the flipped order and are read straight from the mapping; the
+			// mip filter and the BC encoder work on RGBA, so BGR is widened while copying out
+			level.width = bmp.width;
+			level.height = bmp.height;
+			level.data.resize((size_t)bmp.width * bmp.height * 4);
+			for (int y = 0; y < bmp.height; y++)
+			{
+				const unsigned char* src = bmp.pixels + (size_t)y * bmp.rowStride;
+				unsigned char* dst = &level.data[(size_t)y * bmp.width * 4];
+				for (int x = 0; x < bmp.width; x++, src += 3, dst += 4)
+				{
+					dst[0] = src[2];
+					dst[1] = src[1];
+					dst[2] = src[0];
+					dst[3] = 255;
+				}
+			}
+			return true;
+		}
+
+		int channel;
+		stbi_uc* pixels = stbi_load_from_memory(data, (int)size, &level.width, &level.height, &channel, 4);
+		if (pixels == NULL)
+			return false;
+
+		level.data.assign(pixels, pixels + (size_t)level.width * level.height * 4);
+		stbi_image_free(pixels);
+		return true;
+	}
+
+	// Load the processed texture from the disk cache, or decode the source and fill the cache
+	bool ProcessImage(DecodeJob& job, TextureImage& image)
+	{
+		if (LoadCachedTexture(job.hash, compressTextures, image))
+			return true;
+
+		vector<TextureImage> layers(job.sources.size());
+		int width = 0, height = 0;
+		for (size_t i = 0; i < layers.size(); i++)
+		{
+			layers[i].format = TEXEL_RGBA8;
+			layers[i].layerCount = 1;
+			layers[i].levels.resize(1);
+			MappedFile file;
+			if (!MapFile(job.sources[i], file))
+				return false;
+			bool decoded = DecodeLevel(file.data, file.size, layers[i].levels[0]);
+			UnmapFile(file);
+			if (!decoded)
+				return false;
+			width = max(width, layers[i].levels[0].width);
+			height = max(height, layers[i].levels[0].height);
+		}
+
+		bool opaque = true;
+		for (size_t i = 0; i < layers.size(); i++)
+		{
+			// the layers of an array share one size, smaller images are stretched to the largest
+			TextureLevel& base = layers[i].levels[0];
+			if (base.width != width || base.height != height)
+			{
+				TextureLevel resized;
+				resized.width = width;
+				resized.height = height;
+				ResampleLevel(base, resized, MIP_FILTER_KAISER, true);
+				base = move(resized);
+			}
+
+			// the BMPs hold sRGB colour, so filter them in linear space
+			// single threaded, the decode workers already keep every core busy
+			GenerateMipChain(layers[i], MIP_FILTER_KAISER, true, 1);
+			opaque = opaque && IsOpaque(&base.data[0], width, height);
+		}
+
+		// one format for the whole array, BC3 as soon as any layer has alpha
+		if (compressTextures)
+		{
+			for (size_t i = 0; i < layers.size(); i++)
+				CompressLevels(layers[i], opaque);
+		}
+
+		image.format = layers[0].format;
+		image.layerCount = (int)layers.size();
+		image.levels.resize(layers[0].levels.size());
+		for (size_t l = 0; l < image.levels.size(); l++)
+		{
+			TextureLevel& level = image.levels[l];
+			level.width = layers[0].levels[l].width;
+			level.height = layers[0].levels[l].height;
+			level.data.clear();
+			for (size_t i = 0; i < layers.size(); i++)
+				level.data.insert(level.data.end(), layers[i].levels[l].data.begin(), layers[i].levels[l].data.end());
+		}
+		SaveCachedTexture(job.hash, image);
+		return true;
+	}
+
+	void DecodeWorker()
+	{
+		for (;;)
+		{
+			DecodeJob job;
+			{
+				unique_lock<mutex> lock(queueMutex);
+				queueCondition.wait(lock, [] { return stopWorkers || !decodeQueue.empty(); });
+				if (stopWorkers)
+					return;
+				job = move(decodeQueue.front());
+				decodeQueue.pop_front();
+			}
+
+			DecodedImage decoded;
+			decoded.handle = job.handle;
+			decoded.path = job.path;
+			decoded.valid = ProcessImage(job, decoded.image);
+
+			{
+				lock_guard<mutex> lock(queueMutex);
+				decodedQueue.push_back(move(decoded));
+			}
+			if (decodeNotify != NULL)
+				decodeNotify();
+		}
+	}
+
+	void StartWorkers()
+	{
+		if (!workers.empty())
+			return;
+
+		// the flip flag is global in stb_image, set it before any worker decodes
+		stbi_set_flip_vertically_on_load(true);
+		compressTextures = HasExtension("GL_EXT_texture_compression_s3tc");
+		stopWorkers = false;
+		int count = max(1, (int)thread::hardware_concurrency() - 1);
+		for (int i = 0; i < count; i++)
+			workers.push_back(thread(DecodeWorker));
+	}
+
+	GLuint FallbackTexture()
+	{
+		if (fallbackTexture == 0)
+		{
+			const unsigned char white[] = { 255, 255, 255, 255 };
+			GLOwnerScope owner("texture streaming");
+			fallbackTexture.Create();
+			SetTexture(0, GL_TEXTURE_2D, fallbackTexture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+		return fallbackTexture;
+	}
+
+	GLuint FallbackArray()
+	{
+		if (fallbackArray == 0)
+		{
+			const unsigned char white[] = { 255, 255, 255, 255 };
+			GLOwnerScope owner("texture streaming");
+			fallbackArray.Create();
+			SetTexture(0, GL_TEXTURE_2D_ARRAY, fallbackArray);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		}
+		return fallbackArray;
+	}
+
+	void DeleteEntryObjects(TextureEntry& entry)
+	{
+		if (entry.fence != 0)
+			glDeleteSync(entry.fence);
+		if (entry.pbo != 0)
+			freePBOs.push_back(move(entry.pbo));
+		entry.tex.Reset();
+		entry.fence = 0;
+		entry.residentLevel = entry.levelCount;
+		entry.uploadLevel = -1;
+	}
+
+	// Texture memory held by entry, counting an upload in flight
+	size_t ResidentBytes(const TextureEntry& entry)
+	{
+		int first = entry.uploadLevel >= 0 ? min(entry.uploadLevel, entry.residentLevel) : entry.residentLevel;
+		size_t size = 0;
+		for (int i = first; i < entry.levelCount; i++)
+			size += entry.levelSizes[i];
+		return size;
+	}
+
+	// Specify levels first .. last of image on the bound texture. With fromBuffer set the data
+	// comes from offsets into the bound pixel buffer, which holds those levels back to back
+	void SpecifyLevels(GLenum target, const TextureImage& image, int first, int last, bool fromBuffer)
+	{
+		GLenum internalFormat = image.format == TEXEL_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		size_t offset = 0;
+		for (int i = first; i <= last; i++)
+		{
+			const TextureLevel& level = image.levels[i];
+			const void* data = fromBuffer ? (const void*)offset : (const void*)&level.data[0];
+			if (target == GL_TEXTURE_2D_ARRAY)
+			{
+				if (image.format == TEXEL_RGBA8)
+					glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGB, level.width, level.height, image.layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+				else
+					glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, internalFormat, level.width, level.height, image.layerCount, 0, (GLsizei)level.data.size(), data);
+			}
+			else if (image.format == TEXEL_RGBA8)
+				glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			else
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, level.width, level.height, 0, (GLsizei)level.data.size(), data);
+			offset += level.data.size();
+		}
+	}
+
+	// Copy levels first .. last into a pixel buffer and let the driver pull them into the texture.
+	// The base level stays where it is until the fence signals, so sampling never sees the new levels early
+	size_t StartUpload(TextureEntry& entry, int first, int last)
+	{
+		size_t size = 0;
+		for (int i = first; i <= last; i++)
+			size += entry.image.levels[i].data.size();
+
+		if (freePBOs.empty())
+		{
+			GLOwnerScope owner("texture streaming");
+			freePBOs.push_back(GLBuffer());
+			freePBOs.back().Create();
+		}
+		entry.pbo = move(freePBOs.back());
+		freePBOs.pop_back();
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, entry.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		entry.pbo.SetBytes(size);
+		unsigned char* dst = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (dst != NULL)
+		{
+			size_t offset = 0;
+			for (int i = first; i <= last; i++)
+			{
+				memcpy(dst + offset, &entry.image.levels[i].data[0], entry.image.levels[i].data.size());
+				offset += entry.image.levels[i].data.size();
+			}
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+
+		if (entry.tex == 0)
+		{
+			GLOwnerScope owner(entry.owner);
+			entry.tex.Create();
+			SetTexture(0, entry.target, entry.tex);
+			glTexParameteri(entry.target, GL_TEXTURE_BASE_LEVEL, entry.levelCount - 1);
+			glTexParameteri(entry.target, GL_TEXTURE_MAX_LEVEL, entry.levelCount - 1);
+		}
+		else
+			SetTexture(0, entry.target, entry.tex);
+		SpecifyLevels(entry.target, entry.image, first, last, true);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		entry.uploadLevel = first;
+		entry.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		entry.tex.SetBytes(ResidentBytes(entry));
+		return size;
+	}
+
+	void FinishUpload(TextureEntry& entry)
+	{
+		glDeleteSync(entry.fence);
+		entry.fence = 0;
+		freePBOs.push_back(move(entry.pbo));
+
+		entry.residentLevel = min(entry.residentLevel, entry.uploadLevel);
+		entry.uploadLevel = -1;
+		SetTexture(0, entry.target, entry.tex);
+		glTexParameteri(entry.target, GL_TEXTURE_BASE_LEVEL, entry.residentLevel);
+		baseLevelsChanged = true;
+		// the whole chain is on the GPU; should dropped levels be wanted again they come back from the disk cache
+		if (entry.residentLevel == 0)
+			entry.image = TextureImage();
+	}
+
+	// Raise the base level to level and give the memory of the finer levels back
+	void DropLevels(TextureEntry& entry, int level)
+	{
+		if (level <= entry.residentLevel || entry.uploadLevel >= 0)
+			return;
+
+		SetTexture(0, entry.target, entry.tex);
+		glTexParameteri(entry.target, GL_TEXTURE_BASE_LEVEL, level);
+		// levels outside base .. max do not count for completeness, an empty image frees them
+		for (int i = entry.residentLevel; i < level; i++)
+		{
+			if (entry.target == GL_TEXTURE_2D_ARRAY)
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGB, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			else
+				glTexImage2D(GL_TEXTURE_2D, i, GL_RGB, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		entry.residentLevel = level;
+		entry.tex.SetBytes(ResidentBytes(entry));
+		baseLevelsChanged = true;
+	}
+
+	// Take over a decoded chain; the first one also fixes the level layout of the entry
+	void AdoptImage(TextureEntry& entry, TextureImage& image)
+	{
+		if (entry.levelCount == 0)
+		{
+			entry.levelCount = (int)image.levels.size();
+			entry.width = image.levels[0].width;
+			entry.height = image.levels[0].height;
+			entry.levelSizes.resize(entry.levelCount);
+			entry.tailLevel = entry.levelCount - 1;
+			for (int i = entry.levelCount - 1; i >= 0; i--)
+			{
+				entry.levelSizes[i] = image.levels[i].data.size();
+				if (image.levels[i].width <= TAIL_MIP_SIZE && image.levels[i].height <= TAIL_MIP_SIZE)
+					entry.tailLevel = i;
+			}
+			entry.residentLevel = entry.levelCount;
+		}
+		entry.image = move(image);
+		entry.evicted = false;
+	}
+
+	void QueueDecode(DecodeJob& job)
+	{
+		{
+			lock_guard<mutex> lock(queueMutex);
+			decodeQueue.push_back(move(job));
+		}
+		queueCondition.notify_one();
+	}
+
+	// Bring entry toward its wanted level: one finer level per call, or drop what the feedback no longer needs.
+	// Only textures drawn recently get more than their tail. Returns the bytes put into a pixel buffer
+	size_t ScheduleLevels(TextureHandle handle, TextureEntry& entry, bool used)
+	{
+		if (entry.levelCount == 0 || entry.uploadLevel >= 0)
+			return 0;
+
+		// the tail goes up in one piece so the texture has something to show
+		if (entry.residentLevel == entry.levelCount)
+			return entry.image.levels.empty() ? 0 : StartUpload(entry, entry.tailLevel, entry.levelCount - 1);
+
+		int wanted = min(entry.wantedLevel, entry.tailLevel);
+		if (wanted < entry.residentLevel)
+		{
+			if (!used)
+				return 0;
+			if (!entry.image.levels.empty())
+				return StartUpload(entry, entry.residentLevel - 1, entry.residentLevel - 1);
+
+			// evicted, fetch the chain again; the tail keeps standing in until it lands
+			if (!entry.requested)
+			{
+				DecodeJob job;
+				job.handle = handle;
+				job.hash = entry.hash;
+				job.sources = entry.sources;
+				job.path = entry.path;
+				entry.requested = true;
+				QueueDecode(job);
+			}
+		}
+		// keep one level of slack so a small zoom does not bounce the finest level in and out
+		else if (wanted > entry.residentLevel + 1)
+			DropLevels(entry, wanted - 1);
+		return 0;
+	}
+
+	// Evict the least recently used textures until the resident ones fit the budget again: they drop to
+	// their tail mips and release the CPU copy. Textures drawn in the last frame are never evicted,
+	// so the budget can be exceeded by the visible set
+	void EnforceMemoryBudget()
+	{
+		size_t resident = 0;
+		for (map<TextureHandle, TextureEntry>::iterator it = textureByHandle.begin(); it != textureByHandle.end(); ++it)
+			resident += ResidentBytes(it->second);
+
+		while (resident > memoryBudget)
+		{
+			TextureEntry* victim = NULL;
+			for (map<TextureHandle, TextureEntry>::iterator it = textureByHandle.begin(); it != textureByHandle.end(); ++it)
+			{
+				TextureEntry& entry = it->second;
+				if (entry.residentLevel >= entry.tailLevel || entry.uploadLevel >= 0 || entry.lastUsedFrame >= frameIndex - 1)
+					continue;
+				if (victim == NULL || entry.lastUsedFrame < victim->lastUsedFrame)
+					victim = &entry;
+			}
+			if (victim == NULL)
+				break;
+
+			resident -= ResidentBytes(*victim);
+			DropLevels(*victim, victim->tailLevel);
+			resident += ResidentBytes(*victim);
+			victim->image = TextureImage();
+			victim->evicted = true;
+		}
+	}
+
+	// Share the entry keyed by hash, or create it and queue the decode of its layers
+	TextureHandle AcquireEntry(unsigned long long hash, GLenum target, const vector<string>& sources)
+	{
+		map<unsigned long long, TextureHandle>::iterator it = handleByHash.find(hash);
+		if (it != handleByHash.end())
+		{
+			textureByHandle[it->second].refCount++;
+			return it->second;
+		}
+
+		TextureHandle handle = nextHandle++;
+		TextureEntry entry = TextureEntry();
+		entry.hash = hash;
+		entry.refCount = 1;
+		entry.target = target;
+		entry.sources = sources;
+		for (size_t i = 0; i < sources.size(); i++)
+			entry.path += (i == 0 ? "" : ", ") + sources[i];
+		entry.uploadLevel = -1;
+		entry.requested = true;
+		entry.owner = CurrentGLOwner();
+		textureByHandle[handle] = move(entry);
+		handleByHash[hash] = handle;
+
+		StartWorkers();
+		FallbackTexture();
+		FallbackArray();
+
+		DecodeJob job;
+		job.handle = handle;
+		job.hash = hash;
+		job.sources = sources;
+		job.path = textureByHandle[handle].path;
+		QueueDecode(job);
+		return handle;
+	}
+}
+
+TextureHandle AcquireTexture(const string& image_path)
+{
+	unsigned long long hash;
+	if (!HashFile(image_path, hash))
+	{
+		cout << "AcquireTexture: Cannot load image from " << image_path << endl;
+		return -1;
+	}
+
+	return AcquireEntry(hash, GL_TEXTURE_2D, vector<string>(1, image_path));
+}
+
+TextureHandle AcquireTextureArray(const vector<string>& image_paths)
+{
+	if (image_paths.empty())
+		return -1;
+
+	vector<unsigned long long> hashes(image_paths.size());
+	for (size_t i = 0; i < image_paths.size(); i++)
+	{
+		if (!HashFile(image_paths[i], hashes[i]))
+		{
+			cout << "AcquireTextureArray: Cannot load image from " << image_paths[i] << endl;
+			return -1;
+		}
+	}
+
+	return AcquireEntry(HashLayers(hashes), GL_TEXTURE_2D_ARRAY, image_paths);
+}
+
+void ReleaseTexture(TextureHandle handle)
+{
+	map<TextureHandle, TextureEntry>::iterator it = textureByHandle.find(handle);
+	if (it == textureByHandle.end() || --it->second.refCount > 0)
+		return;
+
+	// a decode still in flight is dropped when it comes back without an entry
+	DeleteEntryObjects(it->second);
+	handleByHash.erase(it->second.hash);
+	textureByHandle.erase(it);
+}
+
+GLuint GetTextureObject(TextureHandle handle)
+{
+	map<TextureHandle, TextureEntry>::iterator it = textureByHandle.find(handle);
+	if (it == textureByHandle.end())
+		return FallbackTexture();
+
+	TextureEntry& entry = it->second;
+	entry.lastUsedFrame = frameIndex;
+	if (entry.residentLevel >= entry.levelCount)
+		return entry.target == GL_TEXTURE_2D_ARRAY ? FallbackArray() : FallbackTexture();
+	return entry.tex;
+}
+
+bool IsTextureResident(TextureHandle handle)
+{
+	map<TextureHandle, TextureEntry>::iterator it = textureByHandle.find(handle);
+	if (it == textureByHandle.end())
+		return false;
+	const TextureEntry& entry = it->second;
+	return entry.residentLevel < entry.levelCount && entry.residentLevel <= min(entry.wantedLevel, entry.tailLevel);
+}
+
+void SetTextureWantedLevel(TextureHandle handle, int level)
+{
+	map<TextureHandle, TextureEntry>::iterator it = textureByHandle.find(handle);
+	if (it != textureByHandle.end())
+		it->second.wantedLevel = max(0, level);
+}
+
+bool GetTextureSize(TextureHandle handle, int& width, int& height)
+{
+	map<TextureHandle, TextureEntry>::iterator it = textureByHandle.find(handle);
+	if (it == textureByHandle.end() || it->second.levelCount == 0)
+		return false;
+	width = it->second.width;
+	height = it->second.height;
+	return true;
+}
+
+bool UpdateTextureStreaming()
+{
+	frameIndex++;
+	baseLevelsChanged = false;
+
+	// retire uploads whose fence has signaled
+	bool in_flight = false;
+	for (map<TextureHandle, TextureEntry>::iterator it = textureByHandle.begin(); it != textureByHandle.end(); ++it)
+	{
+		TextureEntry& entry = it->second;
+		if (entry.fence == 0)
+			continue;
+
+		GLenum status = glClientWaitSync(entry.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			in_flight = true;
+			continue;
+		}
+
+		FinishUpload(entry);
+	}
+
+	EnforceMemoryBudget();
+
+	// take over what the workers decoded, the uploads happen below
+	for (;;)
+	{
+		DecodedImage decoded;
+		{
+			lock_guard<mutex> lock(queueMutex);
+			if (decodedQueue.empty())
+				break;
+			decoded = move(decodedQueue.front());
+			decodedQueue.pop_front();
+		}
+
+		map<TextureHandle, TextureEntry>::iterator it = textureByHandle.find(decoded.handle);
+		if (it != textureByHandle.end())
+			it->second.requested = false;
+		if (!decoded.valid)
+			cout << "UpdateTextureStreaming: Cannot load image from " << decoded.path << endl;
+		else if (it != textureByHandle.end())
+			AdoptImage(it->second, decoded.image);
+	}
+
+	// stream levels within the per-frame budget, textures drawn last frame first
+	size_t uploaded = 0;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (map<TextureHandle, TextureEntry>::iterator it = textureByHandle.begin(); it != textureByHandle.end() && uploaded < UPLOAD_BUDGET_PER_FRAME; ++it)
+		{
+			bool used = it->second.lastUsedFrame >= frameIndex - 1;
+			if (used == (pass == 0))
+				uploaded += ScheduleLevels(it->first, it->second, used);
+		}
+	}
+	streamingActive = in_flight || uploaded > 0;
+	return baseLevelsChanged;
+}
+
+bool IsTextureStreamingBusy()
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		if (!decodedQueue.empty())
+			return true;
+	}
+	return streamingActive;
+}
+
+void SetTextureDecodeNotify(void (*notify)())
+{
+	decodeNotify = notify;
+}
+
+void ShutdownTextureStreaming()
+{
+	{
+		lock_guard<mutex> lock(queueMutex);
+		stopWorkers = true;
+	}
+	queueCondition.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+
+	decodedQueue.clear();
+	decodeQueue.clear();
+
+	freePBOs.clear();
+	fallbackTexture.Reset();
+	fallbackArray.Reset();
+}
+
+GLuint GetSampler(bool mag_linear, bool min_linear, bool repeat)
+{
+	int key = (mag_linear ? 1 : 0) | (min_linear ? 2 : 0) | (repeat ? 4 : 0);
+	if (samplers[key] == 0)
+	{
+		GLSampler sampler;
+		GLenum wrap = repeat ? GL_REPEAT : GL_MIRRORED_REPEAT;
+		GLOwnerScope owner("samplers");
+		sampler.Create();
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, mag_linear ? GL_LINEAR : GL_NEAREST);
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, min_linear ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrap);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrap);
+		samplers[key] = move(sampler);
+	}
+	return samplers[key];
+}
+
+void DeleteSamplers()
+{
+	for (int i = 0; i < 8; i++)
+		samplers[i].Reset();
+}
+
+void SetTextureMemoryBudget(size_t bytes)
+{
+	memoryBudget = bytes;
+}
+
+void GetTextureMemoryStats(size_t& resident_bytes, size_t& budget_bytes, int& evicted_count)
+{
+	resident_bytes = 0;
+	budget_bytes = memoryBudget;
+	evicted_count = 0;
+	for (map<TextureHandle, TextureEntry>::iterator it = textureByHandle.begin(); it != textureByHandle.end(); ++it)
+	{
+		resident_bytes += ResidentBytes(it->second);
+		if (it->second.evicted)
+			evicted_count++;
+	}
+}
+
+void GetTextureRegistryStats(int& texture_count, int& reference_count, int& pending_count)
+{
+	texture_count = (int)textureByHandle.size();
+	reference_count = 0;
+	pending_count = 0;
+	for (map<TextureHandle, TextureEntry>::iterator it = textureByHandle.begin(); it != textureByHandle.end(); ++it)
+	{
+		reference_count += it->second.refCount;
+		if (it->second.residentLevel >= it->second.levelCount)
+			pending_count++;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+// Texture registry
+// Textures are keyed by the hash of their file content, so materials pointing at the same BMP,
+// or at identical BMPs under different names, share one texture and decode the file once.
+// Files are read through memory mappings, for the hash and again by the decode, never copied whole.
+// Every AcquireTexture must be paired with a ReleaseTexture; the texture is deleted with its last user.
+//
+// Decoding runs on worker threads and the upload goes through pixel buffer objects, a few per frame.
+// Until the small end of the mip chain has landed, GetTextureObject returns a shared fallback texture.
+//
+// Mip streaming: the finer levels follow one at a time within a per-frame byte budget, down to the
+// level the coverage feedback asked for (level 0 without feedback). GL_TEXTURE_BASE_LEVEL is clamped
+// to the finest level whose upload fence has signaled, and levels the feedback stops asking for are freed.
+//
+// Residency: GetTextureObject stamps the texture with the current frame. When the textures exceed the
+// memory budget, the least recently used ones drop to their smallest mips and are streamed back in
+// the background the next time they are asked for.
+
+typedef unsigned int TextureHandle;
+
+// Returns a shared texture for image_path, or -1 if the file cannot be read
+TextureHandle AcquireTexture(const std::string& image_path);
+// Packs the images into one GL_TEXTURE_2D_ARRAY, layer i from image_paths[i], so a whole model
+// binds a single texture. Layers are stretched to the largest image; the array is shared by content like 2D textures
+TextureHandle AcquireTextureArray(const std::vector<std::string>& image_paths);
+void ReleaseTexture(TextureHandle handle);
+
+// GL texture to bind for handle: the real one once resident, the fallback before that.
+// Counts as a use of the texture for eviction, call it for what is actually drawn
+GLuint GetTextureObject(TextureHandle handle);
+// True once every level the feedback asked for is resident
+bool IsTextureResident(TextureHandle handle);
+
+// Finest mip level the coverage feedback saw for handle
+void SetTextureWantedLevel(TextureHandle handle, int level);
+// Level 0 size, false until the texture has been decoded
+bool GetTextureSize(TextureHandle handle, int& width, int& height);
+
+// Called once per frame on the render thread: retires finished uploads and streams levels in or out.
+// True if a texture now samples other levels than before, i.e. the frame looks different
+bool UpdateTextureStreaming();
+// True while decoded images wait for upload or uploads are in flight, i.e. more frames will change textures
+bool IsTextureStreamingBusy();
+// Function the decode workers call after each finished image, e.g. to wake a render loop blocked on events.
+// Runs on a worker thread; set it before the first texture is acquired
+void SetTextureDecodeNotify(void (*notify)());
+// Stop the decode workers, call before the context goes away
+void ShutdownTextureStreaming();
+
+// Number of live textures, the sum of their reference counts and how many are not resident yet
+void GetTextureRegistryStats(int& texture_count, int& reference_count, int& pending_count);
+
+// Bytes of texture memory to stay under, 256 MB by default; textures drawn last frame are never evicted
+void SetTextureMemoryBudget(size_t bytes);
+void GetTextureMemoryStats(size_t& resident_bytes, size_t& budget_bytes, int& evicted_count);
+
+// Sampler cache: one sampler object per filtering and wrapping combination, created on first use
+GLuint GetSampler(bool mag_linear, bool min_linear, bool repeat);
+void DeleteSamplers();
+
+#endif
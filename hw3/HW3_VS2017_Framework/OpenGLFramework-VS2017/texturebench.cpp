@@ -0,0 +1,433 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+#include <glad/glad.h>
+#include <STB/stb_image.h>
+#include "texturebench.h"
+#include "texturecache.h"
+#include "bmploader.h"
+#include "mipmap.h"
+#include "bcencoder.h"
+#include "globject.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+using namespace std;
+
+namespace
+{
+	const int HISTOGRAM_BUCKETS = 24;	// powers of two from 1 us, the last one collects everything slower
+
+	struct StageStats
+	{
+		string name;
+		vector<double> samples;		// milliseconds per texture
+		double bytes;				// input bytes over all samples
+	};
+
+	typedef chrono::steady_clock Clock;
+
+	double ElapsedMs(Clock::time_point start)
+	{
+		return chrono::duration<double, milli>(Clock::now() - start).count();
+	}
+
+	bool HasImageExtension(const string& name)
+	{
+		static const char* extensions[] = { ".bmp", ".png", ".jpg", ".jpeg", ".tga", ".psd", ".gif", ".hdr", ".pic", ".pnm", ".ppm", ".pgm" };
+		string lower = name;
+		transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+		for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+		{
+			size_t length = strlen(extensions[i]);
+			if (lower.size() > length && lower.compare(lower.size() - length, length, extensions[i]) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	vector<string> ListImages(const string& directory)
+	{
+		vector<string> paths;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE)
+			return paths;
+		do
+		{
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && HasImageExtension(data.cFileName))
+				paths.push_back(directory + "\\" + data.cFileName);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR* dir = opendir(directory.c_str());
+		if (dir == NULL)
+			return paths;
+		while (dirent* entry = readdir(dir))
+		{
+			if (entry->d_name[0] != '.' && HasImageExtension(entry->d_name))
+				paths.push_back(directory + "/" + entry->d_name);
+		}
+		closedir(dir);
+#endif
+		sort(paths.begin(), paths.end());
+		return paths;
+	}
+
+	bool ReadFile(const string& path, vector<unsigned char>& bytes)
+	{
+		ifstream file(path.c_str(), ios::binary | ios::ate);
+		if (!file)
+			return false;
+
+		streamsize size = file.tellg();
+		file.seekg(0, ios::beg);
+		bytes.resize((size_t)size);
+		return size > 0 && file.read((char*)&bytes[0], size);
+	}
+
+	void Record(StageStats& stage, double ms, size_t bytes)
+	{
+		stage.samples.push_back(ms);
+		stage.bytes += (double)bytes;
+	}
+
+	// stb_image returns top row first in the file's channel count; flip and widen to RGBA like the loader does
+	void FlipToRGBA(const unsigned char* pixels, int width, int height, int channel, vector<unsigned char>& rgba)
+	{
+		rgba.resize((size_t)width * height * 4);
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* src = pixels + (size_t)(height - 1 - y) * width * channel;
+			unsigned char* dst = &rgba[(size_t)y * width * 4];
+			for (int x = 0; x < width; x++, src += channel, dst += 4)
+			{
+				if (channel >= 3)
+				{
+					dst[0] = src[0];
+					dst[1] = src[1];
+					dst[2] = src[2];
+				}
+				else
+					dst[0] = dst[1] = dst[2] = src[0];
+				dst[3] = channel == 4 ? src[3] : channel == 2 ? src[1] : 255;
+			}
+		}
+	}
+
+	void SwizzleBmp(const BmpImage& bmp, vector<unsigned char>& rgba)
+	{
+		rgba.resize((size_t)bmp.width * bmp.height * 4);
+		for (int y = 0; y < bmp.height; y++)
+		{
+			const unsigned char* src = bmp.pixels + (size_t)y * bmp.rowStride;
+			unsigned char* dst = &rgba[(size_t)y * bmp.width * 4];
+			for (int x = 0; x < bmp.width; x++, src += 3, dst += 4)
+			{
+				dst[0] = src[2];
+				dst[1] = src[1];
+				dst[2] = src[0];
+				dst[3] = 255;
+			}
+		}
+	}
+
+	void CompressChain(TextureImage& image)
+	{
+		bool opaque = IsOpaque(&image.levels[0].data[0], image.levels[0].width, image.levels[0].height);
+		image.format = opaque ? TEXEL_BC1 : TEXEL_BC3;
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			TextureLevel& level = image.levels[i];
+			vector<unsigned char> blocks(opaque ? BC1Size(level.width, level.height) : BC3Size(level.width, level.height));
+			if (opaque)
+				CompressBC1(&level.data[0], level.width, level.height, &blocks[0], 0);
+			else
+				CompressBC3(&level.data[0], level.width, level.height, &blocks[0], 0);
+			level.data.swap(blocks);
+		}
+	}
+
+	// Synchronous upload of the whole chain, glFinish makes the driver copy part of the measurement
+	void UploadChain(const TextureImage& image)
+	{
+		GLTexture tex;
+		tex.Create();
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+		GLenum internalFormat = image.format == TEXEL_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			const TextureLevel& level = image.levels[i];
+			if (image.format == TEXEL_RGBA8)
+				glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGB, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &level.data[0]);
+			else
+				glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, (GLsizei)level.data.size(), &level.data[0]);
+		}
+		glFinish();
+	}
+
+	size_t ChainSize(const TextureImage& image)
+	{
+		size_t size = 0;
+		for (size_t i = 0; i < image.levels.size(); i++)
+			size += image.levels[i].data.size();
+		return size;
+	}
+
+	double Percentile(vector<double> samples, double p)
+	{
+		if (samples.empty())
+			return 0.0;
+		sort(samples.begin(), samples.end());
+		size_t index = (size_t)(p * (samples.size() - 1) + 0.5);
+		return samples[index];
+	}
+
+	void Histogram(const vector<double>& samples, int* counts)
+	{
+		fill(counts, counts + HISTOGRAM_BUCKETS, 0);
+		for (size_t i = 0; i < samples.size(); i++)
+		{
+			double us = samples[i] * 1000.0;
+			int bucket = 0;
+			while (bucket < HISTOGRAM_BUCKETS - 1 && us >= (double)(1 << bucket))
+				bucket++;
+			counts[bucket]++;
+		}
+	}
+
+	double Throughput(const StageStats& stage)
+	{
+		double ms = 0.0;
+		for (size_t i = 0; i < stage.samples.size(); i++)
+			ms += stage.samples[i];
+		return ms > 0.0 ? stage.bytes / (1024.0 * 1024.0) / (ms / 1000.0) : 0.0;
+	}
+
+	void PrintReport(const vector<StageStats>& stages)
+	{
+		printf("%-12s %7s %10s %10s %10s %10s %10s\n", "stage", "count", "MB/s", "mean ms", "p50 ms", "p95 ms", "max ms");
+		for (size_t s = 0; s < stages.size(); s++)
+		{
+			const StageStats& stage = stages[s];
+			if (stage.samples.empty())
+				continue;
+
+			double sum = 0.0;
+			for (size_t i = 0; i < stage.samples.size(); i++)
+				sum += stage.samples[i];
+			printf("%-12s %7d %10.1f %10.3f %10.3f %10.3f %10.3f\n", stage.name.c_str(), (int)stage.samples.size(), Throughput(stage),
+				sum / stage.samples.size(), Percentile(stage.samples, 0.5), Percentile(stage.samples, 0.95), Percentile(stage.samples, 1.0));
+		}
+
+		printf("\nlatency histograms, texture count per bucket\n");
+		for (size_t s = 0; s < stages.size(); s++)
+		{
+			if (stages[s].samples.empty())
+				continue;
+
+			int counts[HISTOGRAM_BUCKETS];
+			Histogram(stages[s].samples, counts);
+			printf("%-12s", stages[s].name.c_str());
+			for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+			{
+				if (counts[b] == 0)
+					continue;
+				if (b == HISTOGRAM_BUCKETS - 1)
+					printf("  >=%dus:%d", 1 << (b - 1), counts[b]);
+				else
+					printf("  <%dus:%d", 1 << b, counts[b]);
+			}
+			printf("\n");
+		}
+	}
+
+	bool WriteJson(const BenchSetting& setting, int file_count, const vector<StageStats>& stages)
+	{
+		ofstream file(setting.jsonPath.c_str());
+		if (!file)
+			return false;
+
+		string directory;
+		for (size_t i = 0; i < setting.directory.size(); i++)
+		{
+			if (setting.directory[i] == '\\' || setting.directory[i] == '"')
+				directory += '\\';
+			directory += setting.directory[i];
+		}
+
+		file << "{\n";
+		file << "  \"directory\": \"" << directory << "\",\n";
+		file << "  \"files\": " << file_count << ",\n";
+		file << "  \"repeat\": " << setting.repeat << ",\n";
+		file << "  \"compress\": " << (setting.compress ? "true" : "false") << ",\n";
+		file << "  \"stages\": [";
+		bool first = true;
+		for (size_t s = 0; s < stages.size(); s++)
+		{
+			const StageStats& stage = stages[s];
+			if (stage.samples.empty())
+				continue;
+
+			double sum = 0.0;
+			for (size_t i = 0; i < stage.samples.size(); i++)
+				sum += stage.samples[i];
+			int counts[HISTOGRAM_BUCKETS];
+			Histogram(stage.samples, counts);
+
+			file << (first ? "\n" : ",\n");
+			first = false;
+			file << "    { \"name\": \"" << stage.name << "\", \"count\": " << stage.samples.size()
+				<< ", \"bytes\": " << (long long)stage.bytes << ", \"mb_per_s\": " << Throughput(stage)
+				<< ", \"mean_ms\": " << sum / stage.samples.size() << ", \"p50_ms\": " << Percentile(stage.samples, 0.5)
+				<< ", \"p95_ms\": " << Percentile(stage.samples, 0.95) << ", \"max_ms\": " << Percentile(stage.samples, 1.0)
+				<< ", \"histogram_us\": [";
+			bool firstBucket = true;
+			for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+			{
+				if (counts[b] == 0)
+					continue;
+				file << (firstBucket ? "" : ", ") << "{ \"below\": ";
+				if (b == HISTOGRAM_BUCKETS - 1)
+					file << "null";
+				else
+					file << (1 << b);
+				file << ", \"count\": " << counts[b] << " }";
+				firstBucket = false;
+			}
+			file << "] }";
+		}
+		file << "\n  ]\n}\n";
+		return (bool)file;
+	}
+}
+
+bool RunTextureBenchmark(const BenchSetting& setting)
+{
+	vector<string> paths = ListImages(setting.directory);
+	if (paths.empty())
+	{
+		cout << "RunTextureBenchmark: No images in " << setting.directory << endl;
+		return false;
+	}
+
+	bool uploadCompressed = false;
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount; i++)
+	{
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0)
+			uploadCompressed = true;
+	}
+
+	enum { READ, STB_DECODE, STB_CONVERT, BMP_DECODE, BMP_CONVERT, MIP, COMPRESS, UPLOAD, STAGE_COUNT };
+	const char* names[STAGE_COUNT] = { "read", "stb.decode", "stb.convert", "bmp.decode", "bmp.convert", "mip", "compress", "upload" };
+	vector<StageStats> stages(STAGE_COUNT);
+	for (int s = 0; s < STAGE_COUNT; s++)
+	{
+		stages[s].name = names[s];
+		stages[s].bytes = 0.0;
+	}
+
+	printf("Benchmarking %d images in %s, %d passes\n", (int)paths.size(), setting.directory.c_str(), setting.repeat);
+	stbi_set_flip_vertically_on_load(false);
+	for (int pass = 0; pass < setting.repeat; pass++)
+	{
+		for (size_t f = 0; f < paths.size(); f++)
+		{
+			Clock::time_point start = Clock::now();
+			vector<unsigned char> bytes;
+			if (!ReadFile(paths[f], bytes))
+			{
+				cout << "RunTextureBenchmark: Cannot read " << paths[f] << endl;
+				continue;
+			}
+			Record(stages[READ], ElapsedMs(start), bytes.size());
+
+			// stb_image: decode in the file's own channel count, then flip and widen separately
+			int width, height, channel;
+			start = Clock::now();
+			stbi_uc* pixels = stbi_load_from_memory(&bytes[0], (int)bytes.size(), &width, &height, &channel, 0);
+			if (pixels == NULL)
+			{
+				cout << "RunTextureBenchmark: Cannot decode " << paths[f] << endl;
+				continue;
+			}
+			Record(stages[STB_DECODE], ElapsedMs(start), bytes.size());
+
+			TextureImage image;
+			image.format = TEXEL_RGBA8;
+			image.layerCount = 1;
+			image.levels.resize(1);
+			image.levels[0].width = width;
+			image.levels[0].height = height;
+			start = Clock::now();
+			FlipToRGBA(pixels, width, height, channel, image.levels[0].data);
+			Record(stages[STB_CONVERT], ElapsedMs(start), (size_t)width * height * channel);
+			stbi_image_free(pixels);
+
+			// BMP reader: header parse in place, then the BGR to RGBA swizzle
+			BmpImage bmp;
+			start = Clock::now();
+			if (ParseBmp(&bytes[0], bytes.size(), bmp))
+			{
+				Record(stages[BMP_DECODE], ElapsedMs(start), bytes.size());
+				vector<unsigned char> rgba;
+				start = Clock::now();
+				SwizzleBmp(bmp, rgba);
+				Record(stages[BMP_CONVERT], ElapsedMs(start), (size_t)bmp.width * bmp.height * 3);
+			}
+
+			start = Clock::now();
+			GenerateMipChain(image, MIP_FILTER_KAISER, true, 0);
+			Record(stages[MIP], ElapsedMs(start), image.levels[0].data.size());
+
+			if (setting.compress)
+			{
+				size_t size = ChainSize(image);
+				start = Clock::now();
+				CompressChain(image);
+				Record(stages[COMPRESS], ElapsedMs(start), size);
+			}
+
+			// drivers without S3TC get the RGBA chain, as in the texture registry
+			if (image.format == TEXEL_RGBA8 || uploadCompressed)
+			{
+				start = Clock::now();
+				UploadChain(image);
+				Record(stages[UPLOAD], ElapsedMs(start), ChainSize(image));
+			}
+		}
+	}
+
+	printf("\n");
+	PrintReport(stages);
+	if (!setting.jsonPath.empty())
+	{
+		if (!WriteJson(setting, (int)paths.size(), stages))
+		{
+			cout << "RunTextureBenchmark: Cannot write " << setting.jsonPath << endl;
+			return false;
+		}
+		printf("\nResults written to %s\n", setting.jsonPath.c_str());
+	}
+	return true;
+}
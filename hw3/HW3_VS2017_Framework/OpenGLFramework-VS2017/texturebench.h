@@ -0,0 +1,23 @@
+#ifndef TEXTURE_BENCH_H
+#define TEXTURE_BENCH_H
+
+#include <string>
+
+// Texture pipeline benchmark
+// Runs every image in a directory through the stages of the texture path one at a time
+// (file read, decode, flip/convert, mip generation, block compression, GL upload) and reports
+// throughput and per-texture latency histograms for each stage. Decode and convert are measured
+// for every loader that accepts the file, so stb_image and the BMP reader can be compared directly.
+// The upload stage needs a current GL context.
+
+struct BenchSetting
+{
+	std::string directory = "../TextureModels";
+	int repeat = 3;				// passes over the directory
+	bool compress = true;		// include the BC1/BC3 stage and upload the compressed chain
+	std::string jsonPath;		// also write the results as JSON when set
+};
+
+bool RunTextureBenchmark(const BenchSetting& setting);
+
+#endif
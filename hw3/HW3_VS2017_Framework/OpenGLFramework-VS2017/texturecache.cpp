@@ -0,0 +1,112 @@
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "texturecache.h"
+
+using namespace std;
+
+namespace
+{
+	const char CACHE_DIR[] = "../TextureCache";
+	const unsigned int CACHE_MAGIC = 0x31435854;	// "TXC1"
+	const unsigned int CACHE_VERSION = 3;			// bump when the layout, mip filter or encoder output changes
+
+	string CachePath(unsigned long long hash, bool compressed)
+	{
+		char name[48];
+		sprintf(name, "/%016llx.%s.tex", hash, compressed ? "bc" : "rgba");
+		return string(CACHE_DIR) + name;
+	}
+
+	void MakeCacheDir()
+	{
+#ifdef _WIN32
+		_mkdir(CACHE_DIR);
+#else
+		mkdir(CACHE_DIR, 0755);
+#endif
+	}
+
+	template <typename T>
+	bool ReadValue(ifstream& file, T& value)
+	{
+		return (bool)file.read((char*)&value, sizeof(T));
+	}
+
+	template <typename T>
+	void WriteValue(ofstream& file, const T& value)
+	{
+		file.write((const char*)&value, sizeof(T));
+	}
+}
+
+bool LoadCachedTexture(unsigned long long hash, bool compressed, TextureImage& image)
+{
+	ifstream file(CachePath(hash, compressed).c_str(), ios::binary);
+	if (!file)
+		return false;
+
+	unsigned int magic, version, format, layerCount, levelCount;
+	if (!ReadValue(file, magic) || !ReadValue(file, version) || !ReadValue(file, format) || !ReadValue(file, layerCount) || !ReadValue(file, levelCount))
+		return false;
+	if (magic != CACHE_MAGIC || version != CACHE_VERSION || format > TEXEL_BC3 || layerCount == 0 || levelCount == 0 || levelCount > 32)
+		return false;
+	if ((format != TEXEL_RGBA8) != compressed)
+		return false;
+
+	image.format = (TexelFormat)format;
+	image.layerCount = (int)layerCount;
+	image.levels.resize(levelCount);
+	for (unsigned int i = 0; i < levelCount; i++)
+	{
+		TextureLevel& level = image.levels[i];
+		unsigned int size;
+		if (!ReadValue(file, level.width) || !ReadValue(file, level.height) || !ReadValue(file, size))
+			return false;
+
+		level.data.resize(size);
+		if (size > 0 && !file.read((char*)&level.data[0], size))
+			return false;
+	}
+	return true;
+}
+
+bool SaveCachedTexture(unsigned long long hash, const TextureImage& image)
+{
+	MakeCacheDir();
+
+	// write to a temporary name first so a crash never leaves a truncated entry behind
+	string path = CachePath(hash, image.format != TEXEL_RGBA8);
+	string tmp_path = path + ".tmp";
+	{
+		ofstream file(tmp_path.c_str(), ios::binary);
+		if (!file)
+			return false;
+
+		WriteValue(file, CACHE_MAGIC);
+		WriteValue(file, CACHE_VERSION);
+		WriteValue(file, (unsigned int)image.format);
+		WriteValue(file, (unsigned int)image.layerCount);
+		WriteValue(file, (unsigned int)image.levels.size());
+		for (size_t i = 0; i < image.levels.size(); i++)
+		{
+			const TextureLevel& level = image.levels[i];
+			WriteValue(file, level.width);
+			WriteValue(file, level.height);
+			WriteValue(file, (unsigned int)level.data.size());
+			if (!level.data.empty())
+				file.write((const char*)&level.data[0], level.data.size());
+		}
+		if (!file)
+			return false;
+	}
+
+	remove(path.c_str());
+	return rename(tmp_path.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,35 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <vector>
+
+// On-disk cache of processed textures (full mip chain, optionally block compressed),
+// keyed by the content hash of the source image so renamed or copied files hit the same entry.
+// Compressed and uncompressed chains of the same source are stored side by side.
+
+enum TexelFormat
+{
+	TEXEL_RGBA8 = 0,
+	TEXEL_BC1 = 1,
+	TEXEL_BC3 = 2
+};
+
+struct TextureLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> data;
+};
+
+struct TextureImage
+{
+	TexelFormat format;
+	int layerCount;						// 1 for plain 2D textures
+	std::vector<TextureLevel> levels;	// level 0 first, each holding every layer back to back
+};
+
+
+bool LoadCachedTexture(unsigned long long hash, bool compressed, TextureImage& image);
+bool SaveCachedTexture(unsigned long long hash, const TextureImage& image);
+
+#endif
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <algorithm>
+#include <string.h>
+#include "uniformblocks.h"
+#include "glstate.h"
+#include "ringbuffer.h"
+
+using namespace std;
+
+namespace
+{
+	GLBuffer lightBuffer;
+	LightBlockStd140 lightBlock;
+	GLint uniformAlignment = 256;	// offset alignment of glBindBufferRange on uniform buffers
+
+	// std140 sizes the shaders rely on
+	static_assert(sizeof(LightStd140) == 96, "LightInfo is 96 bytes in std140");
+	static_assert(sizeof(LightBlockStd140) == MAX_LIGHTS * 96 + 16, "LightBlock layout mismatch");
+	static_assert(sizeof(MaterialStd140) == 64, "MaterialInfo array stride is 64 bytes in std140");
+	static_assert(sizeof(TransformStd140) == 192, "TransformBlock is three mat4");
+}
+
+void InitUniformBlocks()
+{
+	GLOwnerScope owner("uniform blocks");
+	lightBuffer.Create();
+	glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(lightBlock), &lightBlock, GL_DYNAMIC_DRAW);
+	lightBuffer.SetBytes(sizeof(lightBlock));
+	SetUniformBuffer(LIGHT_BLOCK_BINDING, lightBuffer);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+}
+
+void DeleteUniformBlocks()
+{
+	lightBuffer.Reset();
+}
+
+void BindUniformBlocks(GLuint program)
+{
+	GLuint light_index = glGetUniformBlockIndex(program, "LightBlock");
+	GLuint material_index = glGetUniformBlockIndex(program, "MaterialBlock");
+	GLuint transform_index = glGetUniformBlockIndex(program, "TransformBlock");
+	if (light_index == GL_INVALID_INDEX || material_index == GL_INVALID_INDEX || transform_index == GL_INVALID_INDEX)
+		cout << "BindUniformBlocks: Program has no LightBlock, MaterialBlock or TransformBlock" << endl;
+
+	if (light_index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, light_index, LIGHT_BLOCK_BINDING);
+	if (material_index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, material_index, MATERIAL_BLOCK_BINDING);
+	if (transform_index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, transform_index, TRANSFORM_BLOCK_BINDING);
+}
+
+void UpdateLightBlock(const LightStd140* lights, int count)
+{
+	if (count > MAX_LIGHTS)
+		cout << "UpdateLightBlock: Only the first " << MAX_LIGHTS << " of " << count << " lights are used" << endl;
+	count = min(count, MAX_LIGHTS);
+
+	memcpy(lightBlock.light, lights, count * sizeof(LightStd140));
+	lightBlock.lightCount = count;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lightBlock), &lightBlock);
+}
+
+GLBuffer CreateMaterialBuffer()
+{
+	GLBuffer buffer;
+	buffer.Create();
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialStd140), NULL, GL_DYNAMIC_DRAW);
+	buffer.SetBytes(MAX_MATERIALS * sizeof(MaterialStd140));
+	return buffer;
+}
+
+void UpdateMaterialBuffer(GLuint buffer, const MaterialStd140* materials, int count)
+{
+	if (count > MAX_MATERIALS)
+		cout << "UpdateMaterialBuffer: Only the first " << MAX_MATERIALS << " of " << count << " materials are used" << endl;
+	count = min(count, MAX_MATERIALS);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(MaterialStd140), materials);
+}
+
+void BindTransformBlock(const TransformStd140& transforms)
+{
+	GLintptr offset;
+	void* data = AllocateRing(sizeof(transforms), uniformAlignment, offset);
+	if (data == NULL)
+		return;
+	memcpy(data, &transforms, sizeof(transforms));
+	FlushRing();
+	SetUniformBufferRange(TRANSFORM_BLOCK_BINDING, GetRingBuffer(), offset, sizeof(transforms));
+}
@@ -0,0 +1,95 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/glad.h>
+#include "globject.h"
+
+// std140 uniform blocks for lights, materials and transforms
+// The structs below mirror LightBlock, MaterialBlock and TransformBlock in shader.vs.glsl/shader.fs.glsl
+// byte for byte, vec3 members take 16 bytes unless a scalar fills their last 4. Lights live in one
+// buffer updated at most once per frame; every model owns a material buffer holding all of its
+// materials, bound once per model while each draw only selects its entry with the materialIndex
+// uniform. Transforms change every draw, each draw writes its own copy into the ring buffer.
+
+#define MAX_LIGHTS 32			// keep in sync with the shaders
+#define MAX_MATERIALS 128
+
+enum UniformBlockBinding
+{
+	LIGHT_BLOCK_BINDING = 0,
+	MATERIAL_BLOCK_BINDING = 1,
+	TRANSFORM_BLOCK_BINDING = 2
+};
+
+enum LightType
+{
+	LIGHT_DIRECTIONAL = 0,
+	LIGHT_POINT = 1,
+	LIGHT_SPOT = 2
+};
+
+// position and spotDirection are in view space, spotDirection normalized
+struct LightStd140
+{
+	GLfloat position[3];
+	GLint type;
+	GLfloat spotDirection[3];
+	GLfloat pad0;
+	GLfloat ambient[3];
+	GLfloat pad1;
+	GLfloat diffuse[3];
+	GLfloat pad2;
+	GLfloat specular[3];
+	GLfloat spotExponent;
+	GLfloat spotCutoff;
+	GLfloat constantAttenuation;
+	GLfloat linearAttenuation;
+	GLfloat quadraticAttenuation;
+};
+
+struct LightBlockStd140
+{
+	LightStd140 light[MAX_LIGHTS];
+	GLint lightCount;
+	GLint pad[3];
+};
+
+struct MaterialStd140
+{
+	GLfloat Ka[3];
+	GLfloat pad0;
+	GLfloat Kd[3];
+	GLfloat pad1;
+	GLfloat Ks[3];
+	GLfloat shininess;
+	GLint diffuseLayer;
+	GLint pad2[3];
+};
+
+// Matrices of one draw, column major as glUniformMatrix4fv without transpose. The normal matrix is
+// the transposed inverse of modelView, computed once per draw on the CPU
+struct TransformStd140
+{
+	GLfloat modelView[16];
+	GLfloat normalMatrix[16];
+	GLfloat mvp[16];
+};
+
+// Create the light buffer and bind it to its binding point
+void InitUniformBlocks();
+void DeleteUniformBlocks();
+
+// Point the program's LightBlock, MaterialBlock and TransformBlock at their binding points
+void BindUniformBlocks(GLuint program);
+
+// Replace the light buffer contents, the first count lights are used
+void UpdateLightBlock(const LightStd140* lights, int count);
+
+// Material buffer of one model, sized for MAX_MATERIALS
+GLBuffer CreateMaterialBuffer();
+void UpdateMaterialBuffer(GLuint buffer, const MaterialStd140* materials, int count);
+
+// Copy the transforms of the next draw into the ring buffer and bind them to TransformBlock
+void BindTransformBlock(const TransformStd140& transforms);
+
+#endif
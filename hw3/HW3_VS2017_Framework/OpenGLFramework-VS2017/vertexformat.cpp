@@ -0,0 +1,113 @@
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include "vertexformat.h"
+#include "glstate.h"
+
+using namespace std;
+
+namespace
+{
+	const int ATTRIBUTE_COMPONENTS[ATTRIB_COUNT] = { 3, 3, 3, 2 };
+}
+
+VertexFormat MakeVertexFormat(unsigned int mask)
+{
+	VertexFormat format;
+	format.mask = mask;
+	format.stride = 0;
+	for (int i = 0; i < ATTRIB_COUNT; i++)
+	{
+		bool present = (mask & (1u << i)) != 0;
+		format.components[i] = present ? ATTRIBUTE_COMPONENTS[i] : 0;
+		format.offsets[i] = format.stride;
+		format.stride += format.components[i] * (int)sizeof(GLfloat);
+	}
+	return format;
+}
+
+void InterleaveVertices(const VertexFormat& format, const GLfloat* const* streams, int vertex_count, vector<GLfloat>& vertices)
+{
+	int floatsPerVertex = format.stride / (int)sizeof(GLfloat);
+	vertices.resize((size_t)vertex_count * floatsPerVertex);
+	for (int i = 0; i < ATTRIB_COUNT; i++)
+	{
+		int components = format.components[i];
+		if (components == 0 || vertex_count == 0)
+			continue;
+
+		GLfloat* dst = &vertices[format.offsets[i] / sizeof(GLfloat)];
+		const GLfloat* src = streams[i];
+		for (int v = 0; v < vertex_count; v++, dst += floatsPerVertex, src += components)
+		{
+			for (int c = 0; c < components; c++)
+				dst[c] = src[c];
+		}
+	}
+}
+
+int WeldVertices(const VertexFormat& format, vector<GLfloat>& vertices, vector<GLuint>& indices)
+{
+	int floatsPerVertex = format.stride / (int)sizeof(GLfloat);
+	int vertex_count = floatsPerVertex > 0 ? (int)(vertices.size() / floatsPerVertex) : 0;
+	indices.resize(vertex_count);
+	if (vertex_count == 0)
+		return 0;
+
+	// sort so identical vertices sit next to each other, ties keep their original order
+	GLfloat* data = &vertices[0];
+	vector<int> order(vertex_count);
+	for (int v = 0; v < vertex_count; v++)
+		order[v] = v;
+	sort(order.begin(), order.end(), [&](int a, int b)
+	{
+		int c = memcmp(data + (size_t)a * floatsPerVertex, data + (size_t)b * floatsPerVertex, format.stride);
+		return c != 0 ? c < 0 : a < b;
+	});
+
+	// every vertex refers to the first occurrence of its value
+	vector<int> first(vertex_count);
+	for (int i = 0; i < vertex_count; i++)
+	{
+		bool same = i > 0 && memcmp(data + (size_t)order[i] * floatsPerVertex, data + (size_t)order[i - 1] * floatsPerVertex, format.stride) == 0;
+		first[order[i]] = same ? first[order[i - 1]] : order[i];
+	}
+
+	// number the distinct vertices in the order they are first used, which keeps the
+	// original locality, and compact them to the front
+	vector<GLuint> remap(vertex_count);
+	int unique = 0;
+	for (int v = 0; v < vertex_count; v++)
+	{
+		if (first[v] == v)
+		{
+			if (unique != v)
+				memcpy(data + (size_t)unique * floatsPerVertex, data + (size_t)v * floatsPerVertex, format.stride);
+			remap[v] = unique++;
+		}
+		indices[v] = remap[first[v]];
+	}
+	vertices.resize((size_t)unique * floatsPerVertex);
+	return unique;
+}
+
+void SetVertexAttributes(const VertexFormat& format, VertexLayout layout, const GLuint* buffers)
+{
+	for (int i = 0; i < ATTRIB_COUNT; i++)
+	{
+		if (format.components[i] == 0)
+			continue;
+
+		if (layout == LAYOUT_INTERLEAVED)
+		{
+			SetBuffer(GL_ARRAY_BUFFER, buffers[0]);
+			glVertexAttribPointer(i, format.components[i], GL_FLOAT, GL_FALSE, format.stride, (const void*)(size_t)format.offsets[i]);
+		}
+		else
+		{
+			SetBuffer(GL_ARRAY_BUFFER, buffers[i]);
+			glVertexAttribPointer(i, format.components[i], GL_FLOAT, GL_FALSE, 0, 0);
+		}
+		glEnableVertexAttribArray(i);
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <vector>
+#include <glad/glad.h>
+
+// Vertex formats and buffer layouts
+// A format is the set of float attributes a mesh carries; attribute i is bound to shader location i.
+// The interleaved layout packs every vertex into one buffer, [position color normal texcoord] back to
+// back, so a vertex fetch reads one contiguous stride. The split layout keeps one buffer per attribute
+// and is only kept around to compare draw throughput against.
+
+enum VertexAttribute
+{
+	ATTRIB_POSITION = 0,
+	ATTRIB_COLOR = 1,
+	ATTRIB_NORMAL = 2,
+	ATTRIB_TEXCOORD = 3,
+	ATTRIB_COUNT = 4
+};
+
+enum VertexLayout
+{
+	LAYOUT_INTERLEAVED = 0,
+	LAYOUT_SPLIT = 1
+};
+
+struct VertexFormat
+{
+	unsigned int mask;					// bit i set if attribute i is present
+	int components[ATTRIB_COUNT];		// floats per attribute, 0 when absent
+	int offsets[ATTRIB_COUNT];			// byte offset inside an interleaved vertex
+	int stride;							// bytes per interleaved vertex
+};
+
+// Format holding the attributes in mask, e.g. 1 << ATTRIB_POSITION | 1 << ATTRIB_NORMAL
+VertexFormat MakeVertexFormat(unsigned int mask);
+
+// Gather vertex_count vertices whose attributes come as separate streams (streams[i] holds
+// components[i] floats per vertex) into interleaved vertices
+void InterleaveVertices(const VertexFormat& format, const GLfloat* const* streams, int vertex_count, std::vector<GLfloat>& vertices);
+
+// Merge identical interleaved vertices in place and return how many are left.
+// indices gets one entry per original vertex, pointing at its merged copy
+int WeldVertices(const VertexFormat& format, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices);
+
+// Point the bound vertex array at buffers[ATTRIB_COUNT] holding vertices in the given layout,
+// the interleaved layout reads every attribute from buffers[0]. Present attributes get enabled
+void SetVertexAttributes(const VertexFormat& format, VertexLayout layout, const GLuint* buffers);
+
+#endif